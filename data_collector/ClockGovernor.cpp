@@ -0,0 +1,60 @@
+#include <hardware/clocks.h>
+#include <hardware/pll.h>
+
+#include "ClockGovernor.h"
+
+void ClockGovernor::add_uart(uart_inst_t *uart, uint baudrate) {
+    assert(uart_count < CLOCK_MAX_UARTS);
+
+    uarts[uart_count] = uart;
+    baudrates[uart_count] = baudrate;
+    uart_count++;
+}
+
+void ClockGovernor::run_peri_from_usb_pll() {
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, CLOCK_IO_HZ, CLOCK_IO_HZ);
+
+    for (int i = 0; i < uart_count; i++) {
+        uart_set_baudrate(uarts[i], baudrates[i]);
+    }
+}
+
+// The bus is left alone when it was never initialized
+void ClockGovernor::retime_i2c() {
+    if (i2c_bus->i2c != nullptr) {
+        i2c_bus_set_baudrate(i2c_bus, i2c_bus->baudrate);
+    }
+}
+
+// Call after the UARTs have been initialized
+void ClockGovernor::init() {
+    run_peri_from_usb_pll();
+    level = CLOCK_FULL;
+}
+
+// Must not be called while I2C transactions are queued
+void ClockGovernor::set_level(clock_level_t new_level) {
+    if (new_level == level) {
+        return;
+    }
+
+    if (new_level == CLOCK_IO) {
+        clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, CLOCK_IO_HZ, CLOCK_IO_HZ);
+        pll_deinit(pll_sys);
+    } else {
+        pll_init(pll_sys, 1, CLOCK_FULL_VCO_HZ, CLOCK_FULL_POSTDIV1, CLOCK_FULL_POSTDIV2);
+        clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, CLOCK_FULL_HZ, CLOCK_FULL_HZ);
+    }
+
+    level = new_level;
+    retime_i2c();
+}
+
+// sleep_power_up() restores the default clocks, clk_peri included
+void ClockGovernor::on_wake() {
+    run_peri_from_usb_pll();
+    level = CLOCK_FULL;
+    retime_i2c();
+}
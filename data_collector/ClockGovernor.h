@@ -0,0 +1,47 @@
+#ifndef CLOCKGOVERNOR_H
+#define CLOCKGOVERNOR_H
+
+#include <hardware/uart.h>
+
+#include "i2c_bus.h"
+
+// Full speed is the SDK default, 1500 MHz VCO / 6 / 2
+#define CLOCK_FULL_VCO_HZ (1500 * MHZ)
+#define CLOCK_FULL_POSTDIV1 6
+#define CLOCK_FULL_POSTDIV2 2
+#define CLOCK_FULL_HZ (125 * MHZ)
+#define CLOCK_IO_HZ (48 * MHZ)          // Taken from the USB PLL, the system PLL is stopped
+
+#define CLOCK_MAX_UARTS 2
+
+typedef enum {
+    CLOCK_FULL,     // Sampling and encoding
+    CLOCK_IO,       // Waiting on the modem and GPS UARTs
+} clock_level_t;
+
+// Lowers clk_sys while the firmware only waits for I/O and raises it again
+// for bursts of work. clk_peri is moved to the USB PLL, so the UART baud
+// rates do not depend on clk_sys. The I2C bus is clocked from clk_sys and is
+// re-timed at every change, the DHT PIO divider is recomputed from clk_sys
+// at the start of each measurement.
+class ClockGovernor {
+    clock_level_t level = CLOCK_FULL;
+    i2c_bus_t *i2c_bus;
+    uart_inst_t *uarts[CLOCK_MAX_UARTS]{};
+    uint baudrates[CLOCK_MAX_UARTS]{};
+    int uart_count = 0;
+
+    void run_peri_from_usb_pll();
+    void retime_i2c();
+
+public:
+    explicit ClockGovernor(i2c_bus_t *i2c_bus) : i2c_bus(i2c_bus) {}
+
+    void add_uart(uart_inst_t *uart, uint baudrate);
+    void init();
+    void set_level(clock_level_t new_level);
+    void on_wake();
+    clock_level_t get_level() const { return level; }
+};
+
+#endif //CLOCKGOVERNOR_H
@@ -0,0 +1,76 @@
+#include <pico/stdlib.h>
+
+#include "driver_ina219_basic.h"
+#include "dht.h"
+
+#include "EnergyMeter.h"
+#include "PowerRail.h"
+#include "Sensors.h"
+#include "DutyCycle.h"
+
+static const power_profile_t profiles[POWER_PROFILE_COUNT] = {
+    // Report and send every 10 minutes, GPS once a day
+    {"normal", 100000, {INA219_ADC_MODE_12_BIT_32_SAMPLES, 6}, 1, 864, 0, 0},
+    // Report every 30 minutes, send every hour, GPS once a day
+    {"conserve", 300000, {INA219_ADC_MODE_12_BIT_32_SAMPLES, 6}, 2, 288, CONSERVE_ENTER_MV, CONSERVE_EXIT_MV},
+    // Report every hour, send every 4 hours, no GPS
+    {"critical", 600000, {INA219_ADC_MODE_12_BIT_8_SAMPLES, 6}, 4, 0, CRITICAL_ENTER_MV, CRITICAL_EXIT_MV},
+};
+
+const power_profile_t &DutyCycle::get_profile() const {
+    return profiles[profile];
+}
+
+// Returns true when the profile changed
+bool DutyCycle::update(measurement_t battery_mv, measurement_t battery_ma, bool charging, bool power_good) {
+    // The terminal voltage sags under load and rises while charging
+    spare_energy = charging && power_good;
+
+    float ocv_mv = battery_mv - BATTERY_CURRENT_SIGN * battery_ma * BATTERY_INTERNAL_MOHM / 1000.0f;
+
+    // Drop straight to the lowest profile the battery is in
+    power_profile_id_t lower = profile;
+    for (int id = profile + 1; id < POWER_PROFILE_COUNT; id++) {
+        if (ocv_mv < profiles[id].enter_mv) {
+            lower = static_cast<power_profile_id_t>(id);
+        }
+    }
+    if (lower != profile) {
+        profile = lower;
+        settle_count = 0;
+        return true;
+    }
+
+    if (profile == POWER_PROFILE_NORMAL || ocv_mv <= profiles[profile].exit_mv) {
+        settle_count = 0;
+        return false;
+    }
+
+    // Step up one profile at a time. With the charger running on solar power
+    // the load no longer drains the battery, so there is no need to wait.
+    if (++settle_count < PROFILE_SETTLE_READINGS && !spare_energy) {
+        return false;
+    }
+
+    profile = static_cast<power_profile_id_t>(profile - 1);
+    settle_count = 0;
+    return true;
+}
+
+// Pending reports go out with the next report while charging, otherwise
+// once the profile's batch is full
+bool DutyCycle::send_batch_now(int report_count) const {
+    return spare_energy || report_count >= get_profile().reports_per_batch;
+}
+
+// A fix is taken up to a fraction of the GPS interval early while charging,
+// and postponed by up to the same amount while running from the battery
+bool DutyCycle::gps_fix_due(int wakes_left) const {
+    int interval = get_profile().gps_interval;
+    if (interval == 0) {
+        return false;
+    }
+
+    int shift = interval / GPS_SHIFT_DIVIDER;
+    return spare_energy ? wakes_left <= shift : wakes_left <= -shift;
+}
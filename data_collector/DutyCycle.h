@@ -0,0 +1,53 @@
+#ifndef DUTYCYCLE_H
+#define DUTYCYCLE_H
+
+// Battery thresholds, open circuit voltage in mV. A profile is entered below
+// its enter voltage and left above its exit voltage.
+#define CONSERVE_ENTER_MV 3600
+#define CONSERVE_EXIT_MV 3750
+#define CRITICAL_ENTER_MV 3400
+#define CRITICAL_EXIT_MV 3550
+#define BATTERY_INTERNAL_MOHM 150     // Corrects the terminal voltage for the load and charge current
+#define PROFILE_SETTLE_READINGS 6     // Readings above the exit voltage before a profile is left
+#define GPS_SHIFT_DIVIDER 4           // GPS fixes move up to 1/4 of their interval toward charging windows
+
+typedef enum {
+    POWER_PROFILE_NORMAL,
+    POWER_PROFILE_CONSERVE,
+    POWER_PROFILE_CRITICAL,
+    POWER_PROFILE_COUNT
+} power_profile_id_t;
+
+typedef struct {
+    const char *name;
+    uint32_t wake_interval_ms;      // Time between power readings
+    power_sampling_t sampling;      // The report interval is wake_interval_ms * readings_per_report
+    int reports_per_batch;          // Reports held back for one modem session, unless the battery is charging
+    int gps_interval;               // Wakes between GPS fixes, 0 disables the GPS
+    int enter_mv;
+    int exit_mv;
+} power_profile_t;
+
+// Selects the power profile from the battery voltage and the charger signals.
+// Lower profiles are entered as soon as the battery drops below their enter
+// voltage, higher ones only after the battery has stayed above the exit
+// voltage for a while, so the profile does not flap around a threshold.
+class DutyCycle {
+    power_profile_id_t profile = POWER_PROFILE_NORMAL;
+    int settle_count = 0;
+    bool spare_energy = false;
+
+public:
+    bool update(measurement_t battery_mv, measurement_t battery_ma, bool charging, bool power_good);
+
+    // Energy-expensive work is done early while the charger runs on solar
+    // power, and held back within its latency bound otherwise
+    bool has_spare_energy() const { return spare_energy; }
+    bool send_batch_now(int report_count) const;
+    bool gps_fix_due(int wakes_left) const;
+
+    power_profile_id_t get_profile_id() const { return profile; }
+    const power_profile_t &get_profile() const;
+};
+
+#endif //DUTYCYCLE_H
@@ -0,0 +1,60 @@
+#include "EnergyMeter.h"
+
+#define US_PER_HOUR 3.6e9
+
+void EnergyMeter::integrate_battery(float ma, float mw, double hours) {
+    double charge = ma * BATTERY_CURRENT_SIGN * hours;
+    double energy = mw * BATTERY_CURRENT_SIGN * hours;
+
+    if (charge >= 0) {
+        totals.battery_in_mah += charge;
+        totals.battery_in_mwh += energy;
+    } else {
+        totals.battery_out_mah -= charge;
+        totals.battery_out_mwh -= energy;
+    }
+
+    if (soc_valid) {
+        soc_mah += charge;
+        if (soc_mah > BATTERY_CAPACITY_MAH) {
+            soc_mah = BATTERY_CAPACITY_MAH;
+        } else if (soc_mah < 0) {
+            soc_mah = 0;
+        }
+    }
+}
+
+// Readings are integrated with the trapezoidal rule, so a sample interval
+// counts the mean of the power at both ends
+void EnergyMeter::add_sample(float solar_mw, float battery_ma, float battery_mw, bool charging, bool power_good) {
+    absolute_time_t now = get_absolute_time();
+
+    if (!is_nil_time(last_sample)) {
+        int64_t elapsed_us = absolute_time_diff_us(last_sample, now);
+
+        if (elapsed_us > 0 && elapsed_us <= (int64_t)max_gap_ms * 1000) {
+            double hours = (double)elapsed_us / US_PER_HOUR;
+
+            totals.solar_mwh += (last_solar_mw + solar_mw) / 2 * hours;
+            integrate_battery((last_battery_ma + battery_ma) / 2, (last_battery_mw + battery_mw) / 2, hours);
+        } else {
+            totals.gaps++;
+        }
+    }
+
+    // The charger ends a cycle with a full battery
+    if (last_charging && !charging && power_good) {
+        soc_mah = BATTERY_CAPACITY_MAH;
+        soc_valid = true;
+    }
+
+    last_sample = now;
+    last_solar_mw = solar_mw;
+    last_battery_ma = battery_ma;
+    last_battery_mw = battery_mw;
+    last_charging = charging;
+}
+
+float EnergyMeter::get_soc_percent() const {
+    return (float)(soc_mah * 100 / BATTERY_CAPACITY_MAH);
+}
@@ -0,0 +1,49 @@
+#ifndef ENERGYMETER_H
+#define ENERGYMETER_H
+
+#include <pico/time.h>
+
+#define BATTERY_CAPACITY_MAH 3000.0   // Nominal capacity, the state of charge is tracked against it
+#define BATTERY_CURRENT_SIGN 1        // 1 if a positive battery current charges the battery, -1 otherwise
+#define ENERGY_MAX_GAP_MS 60000       // Longer gaps between samples are not integrated, see set_max_gap_ms
+
+// Totals since boot. Charge and energy in and out of the battery are kept
+// apart, their difference is the net change.
+typedef struct {
+    double solar_mwh;               // Harvested
+    double battery_in_mwh;          // Charged
+    double battery_out_mwh;         // Consumed
+    double battery_in_mah;
+    double battery_out_mah;
+    uint32_t gaps;                  // Sample intervals skipped as too long
+} energy_totals_t;
+
+// Integrates the power readings over the time actually elapsed between
+// samples, and counts the battery charge to estimate its state of charge.
+// The estimate is anchored to a full battery when the charger ends a charge
+// cycle, and unknown until then.
+class EnergyMeter {
+    energy_totals_t totals{};
+    absolute_time_t last_sample = nil_time;
+    uint32_t max_gap_ms = ENERGY_MAX_GAP_MS;
+    float last_solar_mw = 0;
+    float last_battery_mw = 0;
+    float last_battery_ma = 0;
+    bool last_charging = false;
+    bool soc_valid = false;
+    double soc_mah = 0;
+
+    void integrate_battery(float ma, float mw, double hours);
+
+public:
+    // The longest sample interval that is still integrated, it has to cover
+    // the sleep and the longest awake window of the current wake interval
+    void set_max_gap_ms(uint32_t ms) { max_gap_ms = ms; }
+    void add_sample(float solar_mw, float battery_ma, float battery_mw, bool charging, bool power_good);
+
+    const energy_totals_t &get_totals() const { return totals; }
+    bool has_soc() const { return soc_valid; }
+    float get_soc_percent() const;
+};
+
+#endif //ENERGYMETER_H
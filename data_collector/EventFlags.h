@@ -0,0 +1,37 @@
+#ifndef EVENTFLAGS_H
+#define EVENTFLAGS_H
+
+#include <hardware/sync.h>
+#include <pico/time.h>
+
+// Bits set from interrupt handlers, callbacks or the other core, waited for
+// with WFE. set() signals an event with SEV, so a bit set between checking
+// and waiting only makes the next WFE return at once and is never missed.
+class EventFlags {
+    volatile uint32_t flags;
+    spin_lock_t *lock;
+
+public:
+    explicit EventFlags(uint32_t initial = 0)
+        : flags(initial), lock(spin_lock_instance(next_striped_spin_lock_num())) {}
+
+    void set(uint32_t mask) {
+        uint32_t irq_state = spin_lock_blocking(lock);
+        flags |= mask;
+        spin_unlock(lock, irq_state);
+        __sev();
+    }
+
+    void clear(uint32_t mask) {
+        uint32_t irq_state = spin_lock_blocking(lock);
+        flags &= ~mask;
+        spin_unlock(lock, irq_state);
+    }
+
+    bool all(uint32_t mask) const { return (flags & mask) == mask; }
+
+    // Sleep until the next event or the deadline, returns false at the deadline
+    bool wait(absolute_time_t deadline) const { return !best_effort_wfe_or_timeout(deadline); }
+};
+
+#endif //EVENTFLAGS_H
@@ -0,0 +1,54 @@
+#ifndef FIXEDSTRING_H
+#define FIXEDSTRING_H
+
+#include <cstddef>
+#include <cstring>
+
+// String with a fixed capacity and no heap allocation. Appends that do not
+// fit are cut off and flag the string as truncated.
+template<size_t N>
+class FixedString {
+    char buf[N + 1] = {0};
+    size_t len = 0;
+    bool truncated = false;
+
+public:
+    void clear() {
+        len = 0;
+        buf[0] = '\0';
+        truncated = false;
+    }
+
+    void append(char c) {
+        if (len < N) {
+            buf[len++] = c;
+            buf[len] = '\0';
+        } else {
+            truncated = true;
+        }
+    }
+
+    void append(const char *s, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            append(s[i]);
+        }
+    }
+
+    void append(const char *s) { append(s, strlen(s)); }
+
+    template<size_t M>
+    void append(const FixedString<M> &s) { append(s.c_str(), s.size()); }
+
+    const char *c_str() const { return buf; }
+    char *data() { return buf; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    bool is_truncated() const { return truncated; }
+    static constexpr size_t capacity() { return N; }
+};
+
+static inline bool starts_with(const char *s, const char *prefix) {
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+#endif //FIXEDSTRING_H
@@ -1,11 +1,9 @@
-#include <iostream>
-#include <string>
+#include <cstring>
 
 #include <hardware/uart.h>
 
 #include "GPS.h"
 
-#include <vector>
 #include <hardware/gpio.h>
 
 #define GPS_TIMEOUT 60
@@ -14,23 +12,22 @@ using namespace std;
 
 int gps_timeout = GPS_TIMEOUT;
 
-std::vector<std::string> split(std::string s, std::string delimiter) {
-    size_t pos_start = 0, pos_end, delim_len = delimiter.length();
-    std::string token;
-    std::vector<std::string> res;
-
-    while ((pos_end = s.find(delimiter, pos_start)) != std::string::npos) {
-        token = s.substr (pos_start, pos_end - pos_start);
-        pos_start = pos_end + delim_len;
-        res.push_back (token);
+// Comma separated NMEA field, not terminated; its length is returned in len
+static const char *nmea_field(const char *line, int index, size_t *len) {
+    for (; index > 0; index--) {
+        line = strchr(line, ',');
+        if (line == nullptr) {
+            return nullptr;
+        }
+        line++;
     }
 
-    res.push_back (s.substr (pos_start));
-    return res;
+    *len = strcspn(line, ",*");
+    return line;
 }
 
-void GPS::on_receive(const string& line) {
-    if (line.rfind("$GPRMC", 0) == 0) {
+void GPS::on_receive(const char *line) {
+    if (starts_with(line, "$GPRMC")) {
         if (oneshot && !--gps_timeout) {
             oneshot = false;
             stop();
@@ -42,22 +39,31 @@ void GPS::on_receive(const string& line) {
             return;
         }
 
-        std::vector<std::string> v = split (line, ",");
+        size_t status_len = 0, time_len = 0, date_len = 0;
+        const char *status = nmea_field(line, 2, &status_len);
+        const char *time = nmea_field(line, 1, &time_len);
+        const char *date = nmea_field(line, 9, &date_len);
 
-        if (v.size() < 2 || v[2] != "A") {
+        if (status == nullptr || status_len != 1 || *status != 'A') {
             gps_data.clear();
             gps_valid = false;
             gps_data_ready = false;
             return;
         }
 
-        gps_data = line;
-        gps_data += "\n";
+        // Discipline the RTC from the first fix of each session
+        if (!gps_valid && date != nullptr && time_len >= 6 && date_len == 6) {
+            timekeeper->sync_gps(time, date);
+        }
+
+        gps_data.clear();
+        gps_data.append(line);
+        gps_data.append('\n');
         gps_valid = true;
         gps_data_ready = false;
     }
-    if (gps_valid && line.rfind("$GPGGA", 0) == 0) {
-        gps_data += line;
+    if (gps_valid && starts_with(line, "$GPGGA")) {
+        gps_data.append(line);
         gps_data_ready = true;
 
         if (oneshot) {
@@ -68,7 +74,8 @@ void GPS::on_receive(const string& line) {
     }
 }
 
-void GPS::on_rx() {
+// Runs from RAM, see README. Complete sentences are parsed from flash.
+void __not_in_flash_func(GPS::on_rx)() {
     while (uart_is_readable(uart)) {
         uint8_t ch = uart_getc(uart);
 
@@ -79,7 +86,7 @@ void GPS::on_rx() {
 
             rx_buffer[rx_index] = '\0';
 
-            on_receive(string(rx_buffer));
+            on_receive(rx_buffer);
 
             rx_index = 0;
             return;
@@ -2,11 +2,16 @@
 #define GPS_H
 
 #define RX_BUF_SIZE 128
+#define GPS_DATA_SIZE 192   // One RMC and one GGA sentence
+
+#include "FixedString.h"
+#include "TimeKeeper.h"
 
 using namespace std;
 
 class GPS {
     uart_inst_t *uart;
+    TimeKeeper *timekeeper;
     uint gpio;
     int rx_index = 0;
     char rx_buffer[RX_BUF_SIZE] = {0};
@@ -16,11 +21,11 @@ class GPS {
     void (*on_ready)();
 
 public:
-    string gps_data;
+    FixedString<GPS_DATA_SIZE> gps_data;
     bool gps_data_ready = false;
 
-    explicit GPS(uart_inst_t *uart, uint gpio, void (*on_ready)()): uart(uart), gpio(gpio), on_ready(on_ready) {}
-    void on_receive(const string& line);
+    explicit GPS(uart_inst_t *uart, TimeKeeper *timekeeper, uint gpio, void (*on_ready)()): uart(uart), timekeeper(timekeeper), gpio(gpio), on_ready(on_ready) {}
+    void on_receive(const char *line);
     void on_rx();
     void start();
     void stop();
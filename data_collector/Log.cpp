@@ -0,0 +1,173 @@
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+
+#include "Log.h"
+
+static char ring[LOG_BUFFER_SIZE];
+static volatile uint32_t ring_head = 0;     // Free running, wrapped on access
+static volatile uint32_t ring_tail = 0;
+static volatile uint32_t dropped = 0;
+
+void LogLine::put_byte(char c) {
+    // Keep room for the newline
+    if (len < LOG_LINE_MAX - 1) {
+        buf[len++] = c;
+    }
+}
+
+#ifdef LOG_TOKENIZED
+
+// Records start with the level, the token and the milliseconds since boot
+LogLine::LogLine(char level, uint32_t token) {
+    put_byte(LOG_RECORD_SYNC);
+    put_byte(0);
+    put_byte(level);
+    for (int i = 0; i < 4; i++) {
+        put_byte(token >> (i * 8));
+    }
+    put_unsigned(time_us_64() / 1000);
+}
+
+// Varint, 7 bits per byte with the top bit set on all but the last
+void LogLine::put_unsigned(uint64_t value) {
+    while (value >= 0x80) {
+        put_byte(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    put_byte(static_cast<char>(value));
+}
+
+void LogLine::put_integer(int64_t value) {
+    put_byte(LOG_ARG_INTEGER);
+    put_unsigned((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void LogLine::put(char c) {
+    put(&c, 1);
+}
+
+void LogLine::put(const char *s, size_t n) {
+    if (n > 255) {
+        n = 255;
+    }
+    put_byte(LOG_ARG_STRING);
+    put_byte(static_cast<char>(n));
+    for (size_t i = 0; i < n; i++) {
+        put_byte(s[i]);
+    }
+}
+
+void LogLine::put(double value) {
+    auto f = static_cast<float>(value);
+    char bytes[sizeof(f)];
+    memcpy(bytes, &f, sizeof(f));
+
+    put_byte(LOG_ARG_FLOAT);
+    for (char b : bytes) {
+        put_byte(b);
+    }
+}
+
+#else
+
+// Messages start with the milliseconds since boot and the level
+LogLine::LogLine(char level) {
+    put('[');
+    put_unsigned(time_us_64() / 1000);
+    put("] ");
+    put(level);
+    put(' ');
+}
+
+void LogLine::put(char c) {
+    put_byte(c);
+}
+
+void LogLine::put(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        put_byte(s[i]);
+    }
+}
+
+void LogLine::put_unsigned(uint64_t value) {
+    char digits[20];
+    int count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (count > 0) {
+        put(digits[--count]);
+    }
+}
+
+void LogLine::put_integer(int64_t value) {
+    if (value < 0) {
+        put('-');
+        put_unsigned(-static_cast<uint64_t>(value));
+    } else {
+        put_unsigned(value);
+    }
+}
+
+// Fixed LOG_FLOAT_DECIMALS, without pulling in the printf float support
+void LogLine::put(double value) {
+    if (value != value) {
+        put("nan");
+        return;
+    }
+    if (value < 0) {
+        put('-');
+        value = -value;
+    }
+
+    uint64_t scale = 1;
+    for (int i = 0; i < LOG_FLOAT_DECIMALS; i++) {
+        scale *= 10;
+    }
+    auto scaled = static_cast<uint64_t>(value * scale + 0.5);
+    put_unsigned(scaled / scale);
+    put('.');
+
+    uint64_t fraction = scaled % scale;
+    for (uint64_t digit = scale / 10; digit > 0; digit /= 10) {
+        put(static_cast<char>('0' + fraction / digit % 10));
+    }
+}
+
+#endif
+
+void LogLine::commit() {
+#ifdef LOG_TOKENIZED
+    // A truncated record is still framed correctly, its last argument is cut short
+    buf[1] = static_cast<char>(len - 2);
+#else
+    buf[len++] = '\n';
+#endif
+
+    // Both cores log, the lock also masks interrupts on this core
+    spin_lock_t *lock = spin_lock_instance(PICO_SPINLOCK_ID_STRIPED_FIRST);
+    uint32_t irq_state = spin_lock_blocking(lock);
+    if (len > LOG_BUFFER_SIZE - (ring_head - ring_tail)) {
+        dropped++;
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            ring[(ring_head + i) % LOG_BUFFER_SIZE] = buf[i];
+        }
+        ring_head += len;
+    }
+    spin_unlock(lock, irq_state);
+}
+
+void log_flush() {
+    while (ring_tail != ring_head) {
+        putchar_raw(ring[ring_tail % LOG_BUFFER_SIZE]);
+        ring_tail++;
+    }
+}
+
+uint32_t log_dropped() {
+    return dropped;
+}
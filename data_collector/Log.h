@@ -0,0 +1,146 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO    // Messages above this level are compiled out
+#endif
+
+#define LOG_BUFFER_SIZE 2048        // Output ring, messages that do not fit are dropped
+#define LOG_LINE_MAX 160            // Longer messages are truncated
+#define LOG_FLOAT_DECIMALS 2
+
+// Tokenized records, decoded on the host by tools/detokenize.py:
+//   LOG_RECORD_SYNC, length of the rest, level, token (4 bytes, little endian),
+//   milliseconds since boot (varint), then each argument as a type tag and value
+#define LOG_RECORD_SYNC 0xA5
+#define LOG_ARG_INTEGER 'i'         // Zigzag varint
+#define LOG_ARG_FLOAT 'f'           // 4 bytes, IEEE 754 little endian
+#define LOG_ARG_STRING 's'          // Length byte and characters
+
+// FNV-1a hash of a format string, the tokenized build sends it instead of the string
+constexpr uint32_t log_token(const char *format, uint32_t hash = 2166136261u) {
+    return *format == '\0' ? hash : log_token(format + 1, (hash ^ static_cast<uint8_t>(*format)) * 16777619u);
+}
+
+// One message, formatted on the stack and committed to the output ring as a whole.
+// In the tokenized build each put encodes one argument instead of text.
+class LogLine {
+    char buf[LOG_LINE_MAX];
+    size_t len = 0;
+
+    void put_byte(char c);
+    void put_integer(int64_t value);
+    void put_unsigned(uint64_t value);
+
+public:
+#ifdef LOG_TOKENIZED
+    LogLine(char level, uint32_t token);
+#else
+    explicit LogLine(char level);
+#endif
+
+    void put(char c);
+    void put(const char *s, size_t n);
+    void put(const char *s) { put(s, strlen(s)); }
+    void put(bool value) { put_integer(value); }
+    void put(double value);
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type put(T value) {
+        put_integer(static_cast<int64_t>(value));
+    }
+
+    void commit();
+};
+
+#ifdef LOG_TOKENIZED
+
+inline void log_arguments(LogLine &line) {}
+
+template<typename T, typename... Args>
+void log_arguments(LogLine &line, const T &value, const Args &... args) {
+    line.put(value);
+    log_arguments(line, args...);
+}
+
+template<typename... Args>
+void log_tokenized(char level, uint32_t token, const Args &... args) {
+    LogLine line(level, token);
+    log_arguments(line, args...);
+    line.commit();
+}
+
+// The token is computed at compile time, the format string is not linked in
+#define LOG_MESSAGE(level, format, ...) \
+    log_tokenized(level, std::integral_constant<uint32_t, log_token(format)>::value, ##__VA_ARGS__)
+
+#else
+
+inline void log_format(LogLine &line, const char *format) {
+    line.put(format);
+}
+
+// Each {} in the format is replaced by the next argument
+template<typename T, typename... Args>
+void log_format(LogLine &line, const char *format, const T &value, const Args &... args) {
+    const char *field = strstr(format, "{}");
+    if (field == nullptr) {
+        line.put(format);
+        return;
+    }
+    line.put(format, field - format);
+    line.put(value);
+    log_format(line, field + 2, args...);
+}
+
+// Safe to call from interrupt context and either core, the output happens in log_flush
+template<typename... Args>
+void log_message(char level, const char *format, const Args &... args) {
+    LogLine line(level);
+    log_format(line, format, args...);
+    line.commit();
+}
+
+#define LOG_MESSAGE(level, ...) log_message(level, __VA_ARGS__)
+
+#endif
+
+// Write the buffered messages to stdio, from the main loop only
+void log_flush();
+uint32_t log_dropped();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_MESSAGE('E', __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_MESSAGE('W', __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_MESSAGE('I', __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_MESSAGE('D', __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#endif //LOG_H
@@ -1,19 +1,15 @@
-#include <iostream>
-#include <string>
 #include <cstring>
-#include <utility>
-#include <vector>
 
 #include <hardware/uart.h>
-#include <hardware/rtc.h>
 #include <pico/time.h>
-#include <pico/util/datetime.h>
 
+#include "FixedString.h"
+#include "Log.h"
 #include "MQTT.h"
 
 using namespace std;
 
-vector<vector<string>> nbiot_cmds = {
+static constexpr mqtt_cmd_t nbiot_cmds[] = {
     {"AT+QSCLK=0\r\n", "OK"},
     {"AT+QIDNSCFG=0,\"8.8.8.8\"\r\n", "OK"},
     {"AT+CCLK?\r\n", "+CCLK:"},
@@ -23,33 +19,50 @@ vector<vector<string>> nbiot_cmds = {
     // {"AT+QCFG=\"wakeupRXD\",0\r\n", "OK"},
     // {"AT+QSCLK=1\r\n", "OK"},
 };
+static constexpr int nbiot_cmd_count = sizeof(nbiot_cmds) / sizeof(nbiot_cmds[0]);
+
+static constexpr mqtt_cmd_t mqtt_cmds[] = {
+    // {"AT", "OK"},
+    // {"AT+QSCLK=0", "OK"},
+    {"AT+QMTOPEN=0,\"137.135.83.217\",1883", "+QMTOPEN: 0,0"},
+    {"AT+QMTCONN=0,\"pollen-bc660\"", "+QMTCONN: 0,0"},
+    {"AT+QMTPUB=0,0,0,0,\"/pollen\"", "+QMTPUB: 0,0"},
+    {"AT+QMTDISC=0", "+QMTDISC: 0,0"},
+    // {"AT+QMTCLOSE=0", "+QMTCLOSE: 0,0"},
+    // {"AT+QSCLK=1", "OK"},
+};
+static constexpr int mqtt_cmd_count = sizeof(mqtt_cmds) / sizeof(mqtt_cmds[0]);
 
 void MQTT::send_next_cmd() {
     if (mqtt_connected) {
         return;
     }
-    if (cmd_index >= nbiot_cmds.size()) {
+    // Only query the network clock when the RTC is predicted to be off
+    if (cmd_index < nbiot_cmd_count && strcmp(nbiot_cmds[cmd_index].ok_response, "+CCLK:") == 0 && !timekeeper->needs_sync()) {
+        cmd_index++;
+    }
+    if (cmd_index >= nbiot_cmd_count) {
         mqtt_connected = true;
         if (on_publish_done != NULL) {
             on_publish_done(true);
         }
         return;
     }
-    cout << "Sending command: " << nbiot_cmds[cmd_index][0] << endl;
-    uart_puts(uart, nbiot_cmds[cmd_index][0].c_str());
+    LOG_DEBUG("Sending command: {}", nbiot_cmds[cmd_index].cmd);
+    uart_puts(uart, nbiot_cmds[cmd_index].cmd);
     uart_tx_wait_blocking(uart);
     sent_cmd_index = cmd_index;
 }
 
 void MQTT::send_next_mqtt_cmd() {
-    if (mqtt_cmd_index >= mqtt_cmds.size()) {
+    if (mqtt_cmd_index >= mqtt_cmd_count) {
         if (on_publish_done != NULL) {
             on_publish_done(true);
         }
         return;
     }
-    cout << "Sending command: " << mqtt_cmds[mqtt_cmd_index].cmd << endl;
-    uart_puts(uart, mqtt_cmds[mqtt_cmd_index].cmd.c_str());
+    LOG_DEBUG("Sending command: {}", mqtt_cmds[mqtt_cmd_index].cmd);
+    uart_puts(uart, mqtt_cmds[mqtt_cmd_index].cmd);
     uart_puts(uart, "\r\n");
     uart_tx_wait_blocking(uart);
     mqtt_sent_cmd_index = mqtt_cmd_index;
@@ -62,7 +75,7 @@ void MQTT::mqtt_publish_data() {
     mqtt_ready_to_send = false;
 }
 
-void MQTT::publish(char *data) {
+void MQTT::publish(const char *data) {
     if (on_publish_done != NULL) {
         on_publish_done(false);
     }
@@ -74,42 +87,43 @@ void MQTT::publish(char *data) {
     send_next_mqtt_cmd();
 }
 
-void MQTT::on_receive(const string& line) {
-    cout << "NB-IoT: " << line << endl;
+void MQTT::on_receive(const char *line) {
+    LOG_DEBUG("NB-IoT: {}", line);
 
-    if (line.rfind("ERROR", 0) == 0) {
+    if (starts_with(line, "ERROR")) {
         mqtt_connected = false;
         reset();
     }
 
-    if (line.rfind("+CCLK:", 0) == 0) {
-        set_rtc(line.substr(7));
+    if (starts_with(line, "+CCLK:") && strlen(line) >= 24) {
+        timekeeper->sync_modem(line + 7);
     }
 
-    if (line.rfind("+CEREG: 5", 0) == 0) {
+    if (starts_with(line, "+CEREG: 5")) {
         cmd_index = 0;
         mqtt_connected = false;
         send_next_cmd();
     }
 
-    if (!mqtt_connected && sent_cmd_index > -1 && line.rfind(nbiot_cmds[sent_cmd_index][1]) == 0)
+    if (!mqtt_connected && sent_cmd_index > -1 && starts_with(line, nbiot_cmds[sent_cmd_index].ok_response))
     {
         cmd_index++;
         send_next_cmd();
     }
 
-    if (mqtt_sent_cmd_index > -1 && line.rfind(mqtt_cmds[mqtt_sent_cmd_index].ok_response) == 0)
+    if (mqtt_sent_cmd_index > -1 && starts_with(line, mqtt_cmds[mqtt_sent_cmd_index].ok_response))
     {
         mqtt_cmd_index++;
         send_next_mqtt_cmd();
     }
 
-    if (line == ">" && mqtt_ready_to_send) {
+    if (strcmp(line, ">") == 0 && mqtt_ready_to_send) {
         mqtt_publish_data();
     }
 }
 
-void MQTT::on_rx() {
+// Runs from RAM, see README. Complete lines are parsed from flash.
+void __not_in_flash_func(MQTT::on_rx)() {
     while (uart_is_readable(uart)) {
         uint8_t ch = uart_getc(uart);
 
@@ -120,7 +134,7 @@ void MQTT::on_rx() {
 
             rx_buffer[rx_index] = '\0';
 
-            on_receive(string(rx_buffer));
+            on_receive(rx_buffer);
 
             rx_index = 0;
             return;
@@ -136,23 +150,9 @@ void MQTT::reset() {
     uart_puts(uart, "AT+QRST=1\r\n");
 }
 
-void MQTT::set_rtc(string datetime) {
-    datetime_t t = {
-        .year  = (int16_t)stoi(datetime.substr(0,2)),
-        .month = (int8_t)stoi(datetime.substr(3,2)),
-        .day   = (int8_t)stoi(datetime.substr(6,2)),
-        .dotw  = 0, // 0 is Sunday, so 5 is Friday
-        .hour  = (int8_t)stoi(datetime.substr(9,2)),
-        .min   = (int8_t)stoi(datetime.substr(12,2)),
-        .sec   = (int8_t)stoi(datetime.substr(15,2)),
-    };
-
-    rtc_set_datetime(&t);
-}
-
-void MQTT::cmd(string cmd, string ok_response, void (*cb)()) {
-    callback_on_resp = move(ok_response);
+void MQTT::cmd(const char *cmd, const char *ok_response, void (*cb)()) {
+    callback_on_resp = ok_response;
     callback_func = cb;
-    uart_puts(uart, cmd.c_str());
+    uart_puts(uart, cmd);
     uart_puts(uart, "\r\n");
 }
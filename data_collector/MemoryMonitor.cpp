@@ -0,0 +1,50 @@
+#include <pico/stdlib.h>
+
+#include "MemoryMonitor.h"
+
+// Linker script symbols
+extern uint32_t __StackBottom;
+extern uint32_t __StackTop;
+extern uint32_t __StackOneBottom;
+extern uint32_t __StackOneTop;
+extern char __end__;
+extern char __HeapLimit;
+
+extern "C" void *_sbrk(int incr);
+
+static void paint(uint32_t *bottom, uint32_t *top) {
+    for (uint32_t *p = bottom; p < top; p++) {
+        *p = STACK_PAINT;
+    }
+}
+
+// Stacks grow down, the deepest use is the lowest overwritten word
+static stack_usage_t scan(uint32_t *bottom, uint32_t *top) {
+    uint32_t *p = bottom;
+    while (p < top && *p == STACK_PAINT) {
+        p++;
+    }
+
+    return {
+        static_cast<uint32_t>((top - bottom) * sizeof(uint32_t)),
+        static_cast<uint32_t>((top - p) * sizeof(uint32_t)),
+    };
+}
+
+// Must run on core 0 before core 1 is launched
+void MemoryMonitor::paint_stacks() {
+    uint32_t *sp;
+    __asm volatile ("mov %0, sp" : "=r" (sp));
+
+    paint(&__StackBottom, sp - STACK_PAINT_MARGIN / sizeof(uint32_t));
+    paint(&__StackOneBottom, &__StackOneTop);
+}
+
+const memory_stats_t &MemoryMonitor::update() {
+    stats.core0 = scan(&__StackBottom, &__StackTop);
+    stats.core1 = scan(&__StackOneBottom, &__StackOneTop);
+    stats.heap_used = static_cast<char *>(_sbrk(0)) - &__end__;
+    stats.heap_size = &__HeapLimit - &__end__;
+
+    return stats;
+}
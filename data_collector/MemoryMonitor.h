@@ -0,0 +1,33 @@
+#ifndef MEMORYMONITOR_H
+#define MEMORYMONITOR_H
+
+#include <cstdint>
+
+#define STACK_PAINT 0xDEADBEEF
+#define STACK_PAINT_MARGIN 64       // Bytes below the stack pointer left unpainted at startup
+
+typedef struct {
+    uint32_t size;
+    uint32_t peak;                  // Deepest use since boot, in bytes
+} stack_usage_t;
+
+typedef struct {
+    stack_usage_t core0;            // Also taken by exceptions and interrupts on core 0
+    stack_usage_t core1;
+    uint32_t heap_used;             // Claimed from the heap arena, malloc never returns it
+    uint32_t heap_size;
+} memory_stats_t;
+
+// Paints both stacks with a pattern at boot, so the deepest use can later be
+// found as the first overwritten word. Both cores run their interrupt
+// handlers on the main stack, so it also covers the exception stack.
+class MemoryMonitor {
+    memory_stats_t stats{};
+
+public:
+    void paint_stacks();
+    const memory_stats_t &update();
+    const memory_stats_t &get_stats() const { return stats; }
+};
+
+#endif //MEMORYMONITOR_H
@@ -0,0 +1,99 @@
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/structs/scb.h>
+#include <pico/multicore.h>
+
+#include "ModemCore.h"
+
+ModemCore *ModemCore::instance = nullptr;
+
+void ModemCore::core1_entry() {
+    instance->run();
+}
+
+void __not_in_flash_func(ModemCore::on_uart_rx)() {
+    instance->mqtt->on_rx();
+}
+
+// Interrupts are enabled per core, this must run on core 1
+void ModemCore::set_rx_enabled(bool enabled) {
+    int irq = uart == uart0 ? UART0_IRQ : UART1_IRQ;
+
+    if (enabled) {
+        irq_set_exclusive_handler(irq, on_uart_rx);
+        irq_set_enabled(irq, true);
+        uart_set_irq_enables(uart, true, false);
+    } else {
+        irq_set_enabled(irq, false);
+        irq_clear(irq);
+        uart_set_irq_enables(uart, false, false);
+    }
+}
+
+// Core 1 sleeps in the FIFO (WFE) between requests, the AT engine itself is
+// driven by the UART interrupt. Suspend and resume are acknowledged through
+// the FIFO back to core 0.
+//
+// The chip only gates the clocks of a light sleep once both cores are in deep
+// sleep. While suspended, core 1 sets SLEEPDEEP so its WFE counts as deep
+// sleep, and clears it again on resume.
+void ModemCore::run() {
+    set_rx_enabled(true);
+
+    while (true) {
+        auto type = static_cast<modem_request_type_t>(multicore_fifo_pop_blocking());
+
+        switch (type) {
+            case MODEM_PUBLISH:
+                mqtt->publish(reinterpret_cast<const char *>(multicore_fifo_pop_blocking()));
+                break;
+            case MODEM_SUSPEND:
+                set_rx_enabled(false);
+                scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+                multicore_fifo_push_blocking(type);
+                break;
+            case MODEM_RESUME:
+                scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+                set_rx_enabled(true);
+                multicore_fifo_push_blocking(type);
+                break;
+        }
+    }
+}
+
+void ModemCore::request(modem_request_type_t type) {
+    multicore_fifo_push_blocking(type);
+}
+
+void ModemCore::start() {
+    instance = this;
+    multicore_launch_core1(core1_entry);
+}
+
+// Interrupts are masked so a publish from an interrupt handler cannot land
+// between the two words. Core 1 keeps draining the FIFO meanwhile.
+void ModemCore::publish(const char *data) {
+    uint32_t irq_state = save_and_disable_interrupts();
+    request(MODEM_PUBLISH);
+    multicore_fifo_push_blocking(reinterpret_cast<uintptr_t>(data));
+    restore_interrupts(irq_state);
+}
+
+// Returns once core 1 has stopped taking modem interrupts
+void ModemCore::suspend() {
+    if (instance == nullptr) {
+        return;
+    }
+
+    request(MODEM_SUSPEND);
+    multicore_fifo_pop_blocking();
+}
+
+void ModemCore::resume() {
+    if (instance == nullptr) {
+        return;
+    }
+
+    request(MODEM_RESUME);
+    multicore_fifo_pop_blocking();
+}
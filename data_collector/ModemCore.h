@@ -0,0 +1,42 @@
+#ifndef MODEMCORE_H
+#define MODEMCORE_H
+
+#include <hardware/uart.h>
+
+#include "MQTT.h"
+
+// Request words sent to core 1, MODEM_PUBLISH is followed by the payload
+// address. The payload must stay valid until the publish is done.
+typedef enum {
+    MODEM_PUBLISH,
+    MODEM_SUSPEND,      // Stop modem RX interrupts and let core 1 deep sleep before the system sleeps
+    MODEM_RESUME,
+} modem_request_type_t;
+
+// Runs the modem UART and the AT command engine on core 1, so modem latency
+// no longer holds up sampling on core 0. Core 0 sends requests through the
+// SIO inter-core FIFO, which needs no heap and holds 8 words: four publishes,
+// or fewer with a suspend. Publish completion is still reported through the
+// MQTT callback, which then runs on core 1.
+class ModemCore {
+    MQTT *mqtt;
+    uart_inst_t *uart;
+
+    static ModemCore *instance;
+
+    static void core1_entry();
+    static void on_uart_rx();
+    void set_rx_enabled(bool enabled);
+    void run();
+    void request(modem_request_type_t type);
+
+public:
+    ModemCore(MQTT *mqtt, uart_inst_t *uart) : mqtt(mqtt), uart(uart) {}
+
+    void start();
+    void publish(const char *data);
+    void suspend();
+    void resume();
+};
+
+#endif //MODEMCORE_H
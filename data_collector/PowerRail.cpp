@@ -0,0 +1,37 @@
+#include <hardware/gpio.h>
+
+#include "PowerRail.h"
+
+void PowerRail::init() {
+    gpio_init(gpio);
+    gpio_set_dir(gpio, GPIO_OUT);
+    gpio_put(gpio, false);
+    enabled = false;
+}
+
+// Raising an already enabled rail keeps the original timestamp
+void PowerRail::enable() {
+    if (enabled) {
+        return;
+    }
+
+    gpio_put(gpio, true);
+    enabled_at = get_absolute_time();
+    enabled = true;
+}
+
+void PowerRail::disable() {
+    gpio_put(gpio, false);
+    enabled = false;
+}
+
+absolute_time_t PowerRail::settled_at(uint32_t settle_ms) const {
+    if (!enabled) {
+        return at_the_end_of_time;
+    }
+    return delayed_by_ms(enabled_at, settle_ms);
+}
+
+bool PowerRail::is_settled(uint32_t settle_ms) const {
+    return enabled && time_reached(settled_at(settle_ms));
+}
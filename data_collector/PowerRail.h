@@ -0,0 +1,24 @@
+#ifndef POWERRAIL_H
+#define POWERRAIL_H
+
+#include <pico/time.h>
+
+// Switched supply rail that remembers when it was raised, so consumers can
+// wait only for whatever part of their stabilisation time is left
+class PowerRail {
+    uint gpio;
+    bool enabled = false;
+    absolute_time_t enabled_at = nil_time;
+
+public:
+    explicit PowerRail(uint gpio) : gpio(gpio) {}
+
+    void init();
+    void enable();
+    void disable();
+    bool is_enabled() const { return enabled; }
+    absolute_time_t settled_at(uint32_t settle_ms) const;
+    bool is_settled(uint32_t settle_ms) const;
+};
+
+#endif //POWERRAIL_H
@@ -0,0 +1,87 @@
+#include <hardware/structs/busctrl.h>
+#include <hardware/structs/xip_ctrl.h>
+#include <pico/time.h>
+
+#include "Log.h"
+#include "Profiler.h"
+
+#define BUS_COUNTER_MAX 0xFFFFFF
+
+typedef struct {
+    bus_ctrl_perf_counter_t event;
+    const char *name;
+} bus_event_t;
+
+static constexpr bus_event_t bus_events[PROFILER_BUS_COUNTERS] = {
+    {arbiter_xip_main_perf_event_access, "xip"},                // Flash fetches, cached or not
+    {arbiter_xip_main_perf_event_access_contested, "xip_wait"}, // Stalled behind another master
+    {arbiter_rom_perf_event_access, "rom"},                     // Boot ROM float and memory routines
+    {arbiter_apb_perf_event_access, "apb"},                     // Slow peripheral registers
+};
+
+static const char *const region_names[PROFILE_REGION_COUNT] = {
+    "power",
+    "env",
+    "encode",
+};
+
+void Profiler::init() {
+    for (int i = 0; i < PROFILER_BUS_COUNTERS; i++) {
+        bus_ctrl_hw->counter[i].sel = bus_events[i].event;
+    }
+}
+
+void Profiler::begin(profile_region_t region) {
+    assert(active < 0);
+
+    active = region;
+    for (auto &counter : bus_ctrl_hw->counter) {
+        counter.value = 0;
+    }
+    // The XIP counters are cleared before each sleep, see sample_xip_counters
+    start_hits = xip_ctrl_hw->ctr_hit;
+    start_accesses = xip_ctrl_hw->ctr_acc;
+    start_us = time_us_32();
+}
+
+void Profiler::end() {
+    uint32_t us = time_us_32() - start_us;
+    uint32_t hits = xip_ctrl_hw->ctr_hit;
+    uint32_t accesses = xip_ctrl_hw->ctr_acc;
+    profile_totals_t &t = totals[active];
+    bool saturated = accesses == UINT32_MAX;
+
+    for (int i = 0; i < PROFILER_BUS_COUNTERS; i++) {
+        uint32_t value = bus_ctrl_hw->counter[i].value;
+        saturated |= value == BUS_COUNTER_MAX;
+        t.bus[i] += value;
+    }
+
+    t.calls++;
+    t.us += us;
+    t.xip_hits += hits - start_hits;
+    t.xip_accesses += accesses - start_accesses;
+    if (saturated) {
+        t.saturated++;
+    }
+    active = -1;
+}
+
+// One log line per region
+void Profiler::dump() const {
+    LOG_INFO("prof region calls us xip_hit xip_acc {} {} {} {} sat",
+             bus_events[0].name, bus_events[1].name, bus_events[2].name, bus_events[3].name);
+    for (int i = 0; i < PROFILE_REGION_COUNT; i++) {
+        const profile_totals_t &t = totals[i];
+        LOG_INFO("prof {} {} {} {} {} {} {} {} {} {}", region_names[i], t.calls, t.us,
+                 t.xip_hits, t.xip_accesses, t.bus[0], t.bus[1], t.bus[2], t.bus[3], t.saturated);
+    }
+}
+
+const char *Profiler::region_name(profile_region_t region) {
+    return region_names[region];
+}
+
+const char *Profiler::bus_event_name(int counter) {
+    return bus_events[counter].name;
+}
@@ -0,0 +1,47 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+
+#define PROFILER_BUS_COUNTERS 4     // Bus fabric performance counters on the RP2040
+
+typedef enum {
+    PROFILE_POWER_READ,
+    PROFILE_ENVIRONMENT_READ,
+    PROFILE_ENCODE,
+    PROFILE_REGION_COUNT,
+} profile_region_t;
+
+// Totals of one region since boot
+typedef struct {
+    uint32_t calls;
+    uint64_t us;
+    uint64_t xip_hits;
+    uint64_t xip_accesses;
+    uint64_t bus[PROFILER_BUS_COUNTERS];    // Events selected in Profiler.cpp
+    uint32_t saturated;         // Calls in which a counter saturated, their counts are too low
+} profile_totals_t;
+
+// Counts time, XIP cache hits and accesses and bus fabric events per code
+// region. The counters are shared by both cores and DMA, so a region also
+// sees the traffic of whatever runs alongside it. Regions must not nest,
+// the 24 bit bus counters are cleared at the start of each region.
+class Profiler {
+    profile_totals_t totals[PROFILE_REGION_COUNT]{};
+    int active = -1;
+    uint32_t start_us = 0;
+    uint32_t start_hits = 0;
+    uint32_t start_accesses = 0;
+
+public:
+    void init();
+    void begin(profile_region_t region);
+    void end();
+    void dump() const;
+    const profile_totals_t &get_totals(profile_region_t region) const { return totals[region]; }
+
+    static const char *region_name(profile_region_t region);
+    static const char *bus_event_name(int counter);
+};
+
+#endif //PROFILER_H
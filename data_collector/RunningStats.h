@@ -0,0 +1,99 @@
+#ifndef RUNNINGSTATS_H
+#define RUNNINGSTATS_H
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Integer square root, rounded down
+static inline uint64_t isqrt(uint64_t n) {
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > n) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Streaming min/max/mean/variance at constant memory. Integer samples, such
+// as scaled fixed-point measurements, are summed exactly in 64 bits and the
+// results stay integers. Other types use Welford's update so the variance
+// does not suffer from summing large squares; they only need the arithmetic
+// and comparison operators, division by an integer and a conversion to float.
+template<typename T>
+class RunningStats {
+    static constexpr bool exact = std::is_integral<T>::value;
+
+    uint32_t count = 0;
+    T mean = T();
+    T m2 = T();                 // Sum of squared deviations from the mean
+    int64_t sum = 0;            // Integer samples only
+    int64_t sum_squares = 0;
+    T min = T();
+    T max = T();
+
+public:
+    void add(T value) {
+        count++;
+        if (count == 1 || value < min) {
+            min = value;
+        }
+        if (count == 1 || value > max) {
+            max = value;
+        }
+
+        if constexpr (exact) {
+            sum += value;
+            sum_squares += (int64_t)value * value;
+        } else {
+            T delta = value - mean;
+            mean += delta / (int32_t)count;
+            m2 += delta * (value - mean);
+        }
+    }
+
+    void reset() { *this = RunningStats(); }
+
+    uint32_t get_count() const { return count; }
+    T get_min() const { return min; }
+    T get_max() const { return max; }
+
+    // Rounded to the nearest integer for integer samples
+    T get_mean() const {
+        if constexpr (exact) {
+            if (count == 0) {
+                return 0;
+            }
+            int64_t half = sum < 0 ? -(int64_t)(count / 2) : count / 2;
+            return (T)((sum + half) / count);
+        } else {
+            return mean;
+        }
+    }
+
+    // Sample standard deviation, zero until there are two samples
+    typename std::conditional<exact, T, float>::type get_stddev() const {
+        if (count < 2) {
+            return 0;
+        }
+        if constexpr (exact) {
+            // n * sum(x^2) - sum(x)^2 is exact, unlike the floating-point form
+            uint64_t scaled = (uint64_t)(count * sum_squares - sum * sum);
+            return (T)isqrt(scaled / ((uint64_t)count * (count - 1)));
+        } else {
+            return sqrtf(static_cast<float>(m2) / (float)(count - 1));
+        }
+    }
+};
+
+#endif //RUNNINGSTATS_H
@@ -1,73 +1,234 @@
-#include <iostream>
-#include <string>
-
 #include <hardware/gpio.h>
 
 #include "driver_ina219_basic.h"
 #include "dht.h"
 
+#include "PowerRail.h"
 #include "Sensors.h"
 
+#include <hardware/sync.h>
 #include <pico/time.h>
 
 using namespace std;
 
 void Sensors::init() {
-    gpio_put(dht_power_pin, true);
-    gpio_set_pulls(GPIO_DHT1, true, false);
-    gpio_set_pulls(GPIO_DHT2, true, false);
+    power_up_environment();
 
     ina219_basic_init(&power_solar, INA219_ADDRESS_0, 0.1);
     ina219_basic_init(&power_battery, INA219_ADDRESS_1, 0.1);
-    dht_init(&dht1, DHT22, pio0, GPIO_DHT1, false);
-    dht_init(&dht2, DHT22, pio1, GPIO_DHT2, false);
-
-    gpio_disable_pulls(GPIO_DHT1);
-    gpio_disable_pulls(GPIO_DHT2);
-    gpio_put(dht_power_pin, false);
+    set_power_sampling(power_sampling);
+
+    // Both sensors share one PIO block, each with its own state machine and DMA channel
+    dht_channels[0] = {this, {}, &sensor_data.environment.box, 0};
+    dht_channels[1] = {this, {}, &sensor_data.environment.outside, 0};
+    dht_group_init(&dht_group, pio0);
+    for (int i = 0; i < DHT_COUNT; i++) {
+        dht_init(&dht_channels[i].dht, DHT22, pio0, dht_pins[i], false);
+        dht_group_add(&dht_group, &dht_channels[i].dht);
+    }
+
+    power_down_environment();
 }
 
+#ifdef FIXED_POINT
+#define ina219_read_power_data ina219_basic_read_triggered_fixed
+#else
+#define ina219_read_power_data ina219_basic_read_triggered
+#endif
+
+// One triggered conversion per monitor, they stay powered down between wakes
 void Sensors::read_power() {
-    ina219_basic_read(&power_solar,
+    ina219_read_power_data(&power_solar,
         &sensor_data.power.solar.voltage,
         &sensor_data.power.solar.current,
         &sensor_data.power.solar.power);
-    ina219_basic_read(&power_battery,
+    ina219_read_power_data(&power_battery,
         &sensor_data.power.battery.voltage,
         &sensor_data.power.battery.current,
         &sensor_data.power.battery.power);
 }
 
-void Sensors::read_environment() {
-    dht_result_t result;
-    int timeout = 10;
+// Select how many samples the INA219s average per conversion. The
+// configuration register keeps it across triggered conversions.
+bool Sensors::set_power_sampling(const power_sampling_t &sampling) {
+    bool ok = true;
+    ina219_handle_t *handles[] = {&power_solar, &power_battery};
+
+    for (ina219_handle_t *handle : handles) {
+        ok &= ina219_set_shunt_voltage_adc_mode(handle, sampling.adc_mode) == 0;
+        ok &= ina219_set_bus_voltage_adc_mode(handle, sampling.adc_mode) == 0;
+    }
+
+    power_sampling = sampling;
+    return ok;
+}
+
+// Median of a few samples, sorted in place
+static measurement_t median(measurement_t *values, int count) {
+    for (int i = 1; i < count; i++) {
+        measurement_t v = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > v; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = v;
+    }
+
+    if (count % 2) {
+        return values[count / 2];
+    }
+    return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+// Start the first measurement of all sensors at once, after the power-up delay
+int64_t Sensors::on_environment_start(alarm_id_t id, void *user_data) {
+    auto *sensors = static_cast<Sensors *>(user_data);
+
+    for (auto &channel : sensors->dht_channels) {
+        channel.attempts = 1;
+        channel.timeouts = 0;
+        channel.sample_count = 0;
+        channel.retry_delay_ms = sensors->dht_policy.retry_delay_ms;
+    }
+    dht_group_start_measurement_async(&sensors->dht_group, on_dht_group_result, sensors);
+
+    return 0;
+}
 
-    gpio_put(dht_power_pin, true);
+// The first attempt runs as a group, retries and further samples per sensor
+void Sensors::on_dht_group_result(dht_group_t *group, void *user_data) {
+    auto *sensors = static_cast<Sensors *>(user_data);
 
-    gpio_set_pulls(GPIO_DHT1, true, false);
-    gpio_set_pulls(GPIO_DHT2, true, false);
+    for (auto &channel : sensors->dht_channels) {
+        on_dht_result(&channel.dht, channel.dht.result, &channel);
+    }
+}
 
-    sleep_ms(1000);
+int64_t Sensors::on_dht_retry(alarm_id_t id, void *user_data) {
+    auto *channel = static_cast<dht_channel_t *>(user_data);
 
-    do {
-        sleep_ms(100);
-        dht_start_measurement(&dht1);
-        result = dht_finish_measurement_blocking(&dht1,
-        &sensor_data.environment.box.humidity,
-        &sensor_data.environment.box.temperature);
-    } while (result != DHT_RESULT_OK && --timeout);
+    channel->attempts++;
+    dht_start_measurement_async(&channel->dht, on_dht_result, channel);
 
-    timeout = 10;
+    return 0;
+}
 
-    do {
-        sleep_ms(100);
-        dht_start_measurement(&dht2);
-        result = dht_finish_measurement_blocking(&dht2,
-        &sensor_data.environment.outside.humidity,
-        &sensor_data.environment.outside.temperature);
-    } while (result != DHT_RESULT_OK && --timeout);
+void Sensors::retry_dht_channel(dht_channel_t *channel, uint32_t delay_ms) {
+    channel->stats.retries++;
+    add_alarm_in_ms(delay_ms, on_dht_retry, channel, true);
+}
 
-    gpio_disable_pulls(GPIO_DHT1);
-    gpio_disable_pulls(GPIO_DHT2);
-    gpio_put(dht_power_pin, false);
+void Sensors::on_dht_result(dht_t *dht, dht_result_t result, void *user_data) {
+    auto *channel = static_cast<dht_channel_t *>(user_data);
+    Sensors *sensors = channel->sensors;
+    const dht_retry_policy_t &policy = sensors->dht_policy;
+    int wanted_samples = policy.median_samples < DHT_MAX_SAMPLES ? policy.median_samples : DHT_MAX_SAMPLES;
+
+    if (result == DHT_RESULT_OK) {
+#ifdef FIXED_POINT
+        channel->temperature_samples[channel->sample_count] = dht->temperature_centi_c;
+        channel->humidity_samples[channel->sample_count] = dht->humidity_permille;
+#else
+        channel->temperature_samples[channel->sample_count] = dht->temperature_centi_c / 100.0f;
+        channel->humidity_samples[channel->sample_count] = dht->humidity_permille / 10.0f;
+#endif
+        channel->sample_count++;
+
+        // The sensor needs a rest between good readings
+        if (channel->sample_count < wanted_samples && channel->attempts < policy.max_attempts) {
+            add_alarm_in_ms(DHT_SAMPLE_INTERVAL_MS, on_dht_retry, channel, true);
+            return;
+        }
+    } else {
+        if (result == DHT_RESULT_TIMEOUT) {
+            channel->stats.timeouts++;
+            channel->timeouts++;
+        } else {
+            channel->stats.checksum_errors++;
+        }
+
+        bool give_up = channel->attempts >= policy.max_attempts || channel->timeouts >= policy.max_timeouts;
+
+        if (!give_up && result == DHT_RESULT_BAD_CHECKSUM) {
+            // A corrupted frame is line noise, the sensor itself is fine
+            sensors->retry_dht_channel(channel, policy.retry_delay_ms);
+            return;
+        }
+
+        if (!give_up) {
+            sensors->retry_dht_channel(channel, channel->retry_delay_ms);
+            channel->retry_delay_ms *= policy.backoff;
+            if (channel->retry_delay_ms > policy.retry_max_delay_ms) {
+                channel->retry_delay_ms = policy.retry_max_delay_ms;
+            }
+            return;
+        }
+    }
+
+    sensors->finish_dht_channel(channel);
+}
+
+// Publish the reading and power the sensors down once every channel is done
+void Sensors::finish_dht_channel(dht_channel_t *channel) {
+    if (channel->sample_count > 0) {
+        channel->data->temperature = median(channel->temperature_samples, channel->sample_count);
+        channel->data->humidity = median(channel->humidity_samples, channel->sample_count);
+        channel->data->valid = true;
+    } else {
+        channel->data->valid = false;
+        channel->stats.failures++;
+    }
+
+    if (--dht_pending > 0) {
+        return;
+    }
+
+    power_down_environment();
+
+    if (on_environment_done != nullptr) {
+        on_environment_done();
+    }
+}
+
+// Raise the sensor rail ahead of a reading so the stabilisation time can
+// overlap other work. Calling it again keeps the original rail-on time.
+void Sensors::power_up_environment() {
+    sensor_power->enable();
+
+    for (uint pin : dht_pins) {
+        gpio_set_pulls(pin, true, false);
+    }
+}
+
+void Sensors::power_down_environment() {
+    for (uint pin : dht_pins) {
+        gpio_disable_pulls(pin);
+    }
+
+    sensor_power->disable();
+}
+
+// Measure all DHT sensors concurrently, on_done is called from interrupt context.
+// The first measurement starts as soon as the rail has settled, immediately if
+// power_up_environment was called early enough.
+void Sensors::read_environment_async(void (*on_done)()) {
+    on_environment_done = on_done;
+    dht_pending = DHT_COUNT;
+
+    power_up_environment();
+
+    add_alarm_at(sensor_power->settled_at(DHT_POWER_UP_MS), on_environment_start, this, true);
+}
+
+void Sensors::read_environment() {
+    read_environment_async(nullptr);
+
+    // Sleep between the alarm and DMA interrupts that drive the measurement
+    uint32_t irq_state = save_and_disable_interrupts();
+    while (environment_busy()) {
+        __wfi();
+        restore_interrupts(irq_state);
+        irq_state = save_and_disable_interrupts();
+    }
+    restore_interrupts(irq_state);
 }
@@ -1,26 +1,60 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
-#define GPIO_DHT1 13
-#define GPIO_DHT2 15
+// Default INA219 sampling profile
+#define POWER_ADC_MODE INA219_ADC_MODE_12_BIT_32_SAMPLES  // Averaged by the INA219 in one 17 ms conversion
+#define POWER_READINGS_PER_REPORT 6                       // Conversions averaged in firmware per report
+
+#define DHT_COUNT 2
+#define DHT_POWER_UP_MS 1000        // Sensor stabilisation time after the rail is raised
+#define DHT_SAMPLE_INTERVAL_MS 2000 // Minimum time between two good DHT22 readings
+#define DHT_MAX_SAMPLES 5
+
+// Default DHT retry policy
+#define DHT_MAX_ATTEMPTS 6
+#define DHT_MAX_TIMEOUTS 3          // Give up early on a sensor that does not respond
+#define DHT_RETRY_DELAY_MS 100
+#define DHT_RETRY_MAX_DELAY_MS 1000
+#define DHT_RETRY_BACKOFF 2
+#define DHT_MEDIAN_SAMPLES 1        // 1 disables median filtering
 
 using namespace std;
 
+// Measured values are scaled integers when built with FIXED_POINT: mV, mA,
+// mW, hundredths of a degree and tenths of a percent. Otherwise they are
+// floats in mV, mA, mW, degrees and percent.
+#ifdef FIXED_POINT
+typedef int32_t measurement_t;
+#define TEMPERATURE_DECIMALS 2
+#define HUMIDITY_DECIMALS 1
+#else
+typedef float measurement_t;
+#define TEMPERATURE_DECIMALS 0
+#define HUMIDITY_DECIMALS 0
+#endif
+
 typedef struct {
-    float voltage;
-    float current;
-    float power;
+    measurement_t voltage;
+    measurement_t current;
+    measurement_t power;
 } power_data_t;
 
 typedef struct {
     power_data_t solar;
     power_data_t battery;
-    string timestamp;
 } power_t;
 
+// Noise drops with the total number of samples averaged. Hardware averaging
+// costs conversion time within one wake, firmware averaging costs wakes.
 typedef struct {
-    float temperature;
-    float humidity;
+    ina219_adc_mode_t adc_mode;     // Shunt and bus ADC, 12 bit with 1 to 128 samples
+    int readings_per_report;
+} power_sampling_t;
+
+typedef struct {
+    measurement_t temperature;
+    measurement_t humidity;
+    bool valid;                 // False when every attempt of the last reading failed
 } environment_data_t;
 
 typedef struct {
@@ -33,21 +67,81 @@ typedef struct {
     environment_t environment;
 } sensor_data_t;
 
+typedef struct {
+    int max_attempts;           // Measurements started per reading, including retries
+    int max_timeouts;           // Timeouts after which a reading is abandoned
+    uint32_t retry_delay_ms;    // Delay before the first retry
+    uint32_t retry_max_delay_ms;
+    uint32_t backoff;           // Retry delay multiplier, bad checksums retry without backoff
+    int median_samples;         // Good samples combined into one reading by their median
+} dht_retry_policy_t;
+
+// Counted since boot and sent with every report
+typedef struct {
+    uint32_t timeouts;
+    uint32_t checksum_errors;
+    uint32_t retries;
+    uint32_t failures;          // Readings without any good sample
+} dht_stats_t;
+
+class Sensors;
+
+typedef struct {
+    Sensors *sensors;
+    dht_t dht;
+    environment_data_t *data;
+    dht_stats_t stats;
+    int attempts;
+    int timeouts;
+    uint32_t retry_delay_ms;
+    int sample_count;
+    measurement_t temperature_samples[DHT_MAX_SAMPLES];
+    measurement_t humidity_samples[DHT_MAX_SAMPLES];
+} dht_channel_t;
+
 class Sensors {
     ina219_handle_t power_solar{};
     ina219_handle_t power_battery{};
-    dht_t dht1{};
-    dht_t dht2{};
-    uint dht_power_pin;
+    dht_channel_t dht_channels[DHT_COUNT]{};
+    dht_group_t dht_group{};
+    uint dht_pins[DHT_COUNT];
+    PowerRail *sensor_power;
+    volatile int dht_pending = 0;
+    void (*on_environment_done)() = nullptr;
+
+    static int64_t on_environment_start(alarm_id_t id, void *user_data);
+    static void on_dht_group_result(dht_group_t *group, void *user_data);
+    static int64_t on_dht_retry(alarm_id_t id, void *user_data);
+    static void on_dht_result(dht_t *dht, dht_result_t result, void *user_data);
+    void retry_dht_channel(dht_channel_t *channel, uint32_t delay_ms);
+    void finish_dht_channel(dht_channel_t *channel);
+    void power_down_environment();
+
+    power_sampling_t power_sampling = {POWER_ADC_MODE, POWER_READINGS_PER_REPORT};
 
 public:
     sensor_data_t sensor_data{};
+    dht_retry_policy_t dht_policy = {
+        DHT_MAX_ATTEMPTS,
+        DHT_MAX_TIMEOUTS,
+        DHT_RETRY_DELAY_MS,
+        DHT_RETRY_MAX_DELAY_MS,
+        DHT_RETRY_BACKOFF,
+        DHT_MEDIAN_SAMPLES,
+    };
 
-    explicit Sensors(uint dht_power_pin) : dht_power_pin(dht_power_pin) {}
+    Sensors(PowerRail *sensor_power, uint dht_box_pin, uint dht_outside_pin)
+        : dht_pins{dht_box_pin, dht_outside_pin}, sensor_power(sensor_power) {}
 
     void init();
     void read_power();
+    bool set_power_sampling(const power_sampling_t &sampling);
+    const power_sampling_t &get_power_sampling() const { return power_sampling; }
+    void power_up_environment();
+    void read_environment_async(void (*on_done)());
+    bool environment_busy() const { return dht_pending > 0; }
     void read_environment();
+    const dht_stats_t &get_dht_stats(int index) const { return dht_channels[index].stats; }
 };
 
 #endif //SENSORS_H
@@ -0,0 +1,191 @@
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+#include <hardware/rtc.h>
+#include <hardware/sync.h>
+
+#include "TimeKeeper.h"
+
+#define TIME_DRIFT_MAX_PPM 500.0f     // Larger estimates are treated as clock steps
+#define DAYS_1970_TO_2000 10957
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int *y, int *m, int *d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = (int)(yoe + era * 400) + (*m <= 2);
+}
+
+// The RTC year holds two digits, as the modem clock reports it
+static int64_t to_seconds(const datetime_t &t) {
+    int64_t days = days_from_civil(2000 + t.year, t.month, t.day) - DAYS_1970_TO_2000;
+    return days * 86400 + t.hour * 3600 + t.min * 60 + t.sec;
+}
+
+static void from_seconds(int64_t s, datetime_t *t) {
+    int64_t days = s / 86400;
+    int32_t rem = (int32_t)(s % 86400);
+    int y, m, d;
+
+    civil_from_days(days + DAYS_1970_TO_2000, &y, &m, &d);
+
+    t->year = (int16_t)(y - 2000);
+    t->month = (int8_t)m;
+    t->day = (int8_t)d;
+    t->dotw = (int8_t)((6 + days) % 7);     // 2000-01-01 was a Saturday
+    t->hour = (int8_t)(rem / 3600);
+    t->min = (int8_t)(rem / 60 % 60);
+    t->sec = (int8_t)(rem % 60);
+}
+
+static int parse_2digits(const char *s) {
+    if (s[0] < '0' || s[0] > '9' || s[1] < '0' || s[1] > '9') {
+        return -1;
+    }
+    return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+static bool datetime_is_valid(const datetime_t &t) {
+    return t.year >= 0 && t.month >= 1 && t.month <= 12 && t.day >= 1 && t.day <= 31
+        && t.hour >= 0 && t.hour <= 23 && t.min >= 0 && t.min <= 59 && t.sec >= 0 && t.sec <= 59;
+}
+
+int64_t TimeKeeper::rtc_seconds() {
+    datetime_t t;
+    rtc_get_datetime(&t);
+    return to_seconds(t);
+}
+
+void TimeKeeper::sync(time_source_t src, const datetime_t &t) {
+    int64_t ref = to_seconds(t);
+
+    if (synced) {
+        int64_t rtc = rtc_seconds();
+        int64_t elapsed = rtc - last_sync;
+
+        last_offset = (int32_t)(ref - rtc);
+
+        // The RTC is stepped at every sync, so the offsets of short intervals
+        // are summed until the window is long enough for a drift estimate
+        if (elapsed > 0) {
+            drift_window_offset += last_offset;
+            drift_window_elapsed += elapsed;
+        }
+
+        if (drift_window_elapsed >= TIME_DRIFT_MIN_INTERVAL_S) {
+            float measured = (float)drift_window_offset * 1e6f / (float)drift_window_elapsed;
+
+            if (measured < TIME_DRIFT_MAX_PPM && measured > -TIME_DRIFT_MAX_PPM) {
+                drift_ppm = drift_valid ? drift_ppm + TIME_DRIFT_SMOOTHING * (measured - drift_ppm) : measured;
+                drift_valid = true;
+            }
+
+            drift_window_offset = 0;
+            drift_window_elapsed = 0;
+        }
+    }
+
+    datetime_t rtc_time;
+    from_seconds(ref, &rtc_time);
+    rtc_set_datetime(&rtc_time);
+
+    last_sync = ref;
+    source = src;
+    synced = true;
+}
+
+// Modem clock, "yy/MM/dd,hh:mm:ss" as returned by AT+CCLK?
+bool TimeKeeper::sync_modem(const char *cclk) {
+    datetime_t t = {
+        .year  = (int16_t)parse_2digits(cclk),
+        .month = (int8_t)parse_2digits(cclk + 3),
+        .day   = (int8_t)parse_2digits(cclk + 6),
+        .dotw  = 0,
+        .hour  = (int8_t)parse_2digits(cclk + 9),
+        .min   = (int8_t)parse_2digits(cclk + 12),
+        .sec   = (int8_t)parse_2digits(cclk + 15),
+    };
+
+    if (!datetime_is_valid(t)) {
+        return false;
+    }
+
+    sync(TIME_SOURCE_MODEM, t);
+    return true;
+}
+
+// NMEA RMC fields, "hhmmss.ss" and "ddmmyy" in UTC
+bool TimeKeeper::sync_gps(const char *time, const char *date) {
+    datetime_t t = {
+        .year  = (int16_t)parse_2digits(date + 4),
+        .month = (int8_t)parse_2digits(date + 2),
+        .day   = (int8_t)parse_2digits(date),
+        .dotw  = 0,
+        .hour  = (int8_t)parse_2digits(time),
+        .min   = (int8_t)parse_2digits(time + 2),
+        .sec   = (int8_t)parse_2digits(time + 4),
+    };
+
+    if (!datetime_is_valid(t)) {
+        return false;
+    }
+
+    sync(TIME_SOURCE_GPS, t);
+    return true;
+}
+
+float TimeKeeper::predicted_error() {
+    if (!synced) {
+        return FLT_MAX;
+    }
+
+    float ppm = drift_valid ? TIME_DRIFT_RESIDUAL_PPM : TIME_DRIFT_DEFAULT_PPM;
+    float elapsed = (float)(rtc_seconds() - last_sync);
+
+    return TIME_SOURCE_ERROR_S + elapsed * ppm / 1e6f;
+}
+
+bool TimeKeeper::needs_sync() {
+    return predicted_error() > TIME_SYNC_MAX_ERROR_S;
+}
+
+// RTC time corrected for the estimated drift since the last sync
+int64_t TimeKeeper::now() {
+    uint32_t irq_state = save_and_disable_interrupts();
+    int64_t rtc = rtc_seconds();
+    int64_t base = last_sync;
+    float drift = drift_ppm;
+    restore_interrupts(irq_state);
+
+    if (!synced) {
+        return rtc;
+    }
+
+    return rtc + llroundf((float)(rtc - base) * drift / 1e6f);
+}
+
+void TimeKeeper::get_datetime(datetime_t *t) {
+    from_seconds(now(), t);
+}
+
+void TimeKeeper::format_timestamp(char *buf, size_t len) {
+    datetime_t t;
+    get_datetime(&t);
+    snprintf(buf, len, "20%02d-%02d-%02dT%02d:%02d:%02d", t.year, t.month, t.day, t.hour, t.min, t.sec);
+}
@@ -0,0 +1,49 @@
+#ifndef TIMEKEEPER_H
+#define TIMEKEEPER_H
+
+#include <pico/util/datetime.h>
+
+#define TIME_SYNC_MAX_ERROR_S 2.0f        // Re-sync once the predicted RTC error exceeds this
+#define TIME_SOURCE_ERROR_S 1.0f          // RTC resolution, error right after a sync
+#define TIME_DRIFT_DEFAULT_PPM 50.0f      // Assumed drift before it has been measured
+#define TIME_DRIFT_RESIDUAL_PPM 5.0f      // Remaining uncertainty once drift is estimated
+#define TIME_DRIFT_MIN_INTERVAL_S 3600    // Shortest sync interval used to estimate drift
+#define TIME_DRIFT_SMOOTHING 0.25f        // Weight of a new drift estimate
+
+typedef enum {
+    TIME_SOURCE_NONE,
+    TIME_SOURCE_MODEM,
+    TIME_SOURCE_GPS,
+} time_source_t;
+
+// Keeps the RTC disciplined to GNSS or network time. The offset seen at
+// each sync is used to estimate the RTC drift, which then corrects the
+// timestamps taken between syncs.
+class TimeKeeper {
+    bool synced = false;
+    time_source_t source = TIME_SOURCE_NONE;
+    int64_t last_sync = 0;          // Seconds since 2000-01-01 at the last sync
+    int32_t last_offset = 0;        // Reference minus RTC time at the last sync
+    float drift_ppm = 0;            // Positive when the RTC runs slow
+    bool drift_valid = false;
+    int64_t drift_window_offset = 0;     // Offsets summed since the last drift estimate
+    int64_t drift_window_elapsed = 0;
+
+    int64_t rtc_seconds();
+    void sync(time_source_t src, const datetime_t &t);
+
+public:
+    bool sync_modem(const char *cclk);
+    bool sync_gps(const char *time, const char *date);
+    bool needs_sync();
+    float predicted_error();
+    int64_t now();
+    void get_datetime(datetime_t *t);
+    void format_timestamp(char *buf, size_t len);
+
+    float get_drift_ppm() const { return drift_ppm; }
+    int32_t get_last_offset() const { return last_offset; }
+    time_source_t get_source() const { return source; }
+};
+
+#endif //TIMEKEEPER_H
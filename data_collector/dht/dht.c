@@ -8,6 +8,8 @@
 #include <dht.pio.h>
 #include <hardware/clocks.h>
 #include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
 #include <pico/stdlib.h>
 #include <math.h>
 #include <string.h>
@@ -15,6 +17,20 @@
 static const uint PIO_SM_CLOCK_FREQUENCY = 1000000; // 1MHz
 static const uint DHT_LONG_PULSE_THRESHOLD_US = 50;
 static const uint DHT_MEASUREMENT_TIMEOUT_US = 6000;
+static const uint DHT_FRAME_SIZE = 5;
+
+// measurement completed by a DMA channel's IRQ, indexed by channel
+typedef struct {
+    dht_t *dht;
+    dht_group_t *group;
+} dma_irq_target_t;
+
+static dma_irq_target_t dma_irq_targets[NUM_DMA_CHANNELS];
+static bool dma_irq_handler_installed;
+
+// one copy of the program per PIO block, shared by all sensors on it
+static uint8_t program_offsets[NUM_PIOS];
+static uint8_t program_users[NUM_PIOS];
 
 //
 // misc
@@ -33,6 +49,7 @@ static bool pio_sm_is_enabled(PIO pio, uint sm) {
     return (pio->ctrl & (1 << sm)) != 0;
 }
 
+// prepares the state machine and sends the start signal; the caller enables it
 static void dht_program_init(PIO pio, uint sm, uint offset, dht_model_t model, uint data_pin) {
     pio_sm_config c = dht_program_get_default_config(offset);
     uint32_t sys_clock_frequency = clock_get_hz(clk_sys);
@@ -55,40 +72,51 @@ static void dht_program_init(PIO pio, uint sm, uint offset, dht_model_t model, u
     pio_sm_exec(pio, sm, pio_encode_mov(pio_y, pio_osr));
     // pull the long pulse threshold
     pio_sm_exec(pio, sm, pio_encode_pull(/* if_empty */ false, /* block */ true));
-    // start executing the PIO program
-    pio_sm_set_enabled(pio, sm, true);
+    // the TX FIFO is no longer needed; joining gives an 8-deep RX FIFO that holds
+    // a whole frame while a chained DMA channel is still busy with another sensor
+    hw_set_bits(&pio->sm[sm].shiftctrl, PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS);
 }
 
-static void configure_dma_channel(uint chan, PIO pio, uint sm, uint8_t *write_addr) {
+static void configure_dma_channel(uint chan, PIO pio, uint sm, uint8_t *write_addr, uint chain_to, bool raise_irq, bool trigger) {
     dma_channel_config c = dma_channel_get_default_config(chan);
     channel_config_set_dreq(&c, pio_get_dreq(pio, sm, false /* is_tx */));
-    channel_config_set_irq_quiet(&c, true);
+    // completion raises DMA_IRQ_0, see dma_irq_handler
+    channel_config_set_irq_quiet(&c, !raise_irq);
+    channel_config_set_chain_to(&c, chain_to);
     channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
     channel_config_set_read_increment(&c, false);
     channel_config_set_write_increment(&c, true);
-    dma_channel_configure(chan, &c, write_addr, &pio->rxf[sm], 5, true /* trigger */);
+    dma_channel_configure(chan, &c, write_addr, &pio->rxf[sm], DHT_FRAME_SIZE, trigger);
+}
+
+static void abort_dma_channels(uint32_t mask) {
+    dma_hw->abort = mask;
+    while (dma_hw->abort & mask) {
+        tight_loop_contents();
+    }
 }
 
-static float decode_temperature(dht_model_t model, uint8_t b0, uint8_t b1) {
-    float temperature;
+// decoded in hundredths of a degree, so no floating point math is needed
+static int16_t decode_temperature(dht_model_t model, uint8_t b0, uint8_t b1) {
+    int16_t temperature;
     switch (model) {
     case DHT11:
         if (b1 & 0x80) {
             // below-zero temperature not supported
-            temperature = 0.0f;
+            temperature = 0;
         } else {
-            temperature = b0 + 0.1f * (b1 & 0x7F);
+            temperature = b0 * 100 + 10 * (b1 & 0x7F);
         }
         break;
     case DHT12:
-        temperature = b0 + 0.1f * (b1 & 0x7F);
+        temperature = b0 * 100 + 10 * (b1 & 0x7F);
         if (b1 & 0x80) {
             temperature = -temperature;
         }
         break;
     case DHT21:
     case DHT22:
-        temperature = 0.1f * (((b0 & 0x7F) << 8) + b1);
+        temperature = 10 * (((b0 & 0x7F) << 8) + b1);
         if (b0 & 0x80) {
             temperature = -temperature;
         }
@@ -99,16 +127,17 @@ static float decode_temperature(dht_model_t model, uint8_t b0, uint8_t b1) {
     return temperature;
 }
 
-static float decode_humidity(dht_model_t model, uint8_t b0, uint8_t b1) {
-    float humidity;
+// decoded in tenths of a percent
+static uint16_t decode_humidity(dht_model_t model, uint8_t b0, uint8_t b1) {
+    uint16_t humidity;
     switch (model) {
     case DHT11:
     case DHT12:
-        humidity = b0 + 0.1f * b1;
+        humidity = b0 * 10 + b1;
         break;
     case DHT21:
     case DHT22:
-        humidity = 0.1f * ((b0 << 8) + b1);
+        humidity = (b0 << 8) + b1;
         break;
     default:
         assert(false); // invalid model
@@ -116,6 +145,122 @@ static float decode_humidity(dht_model_t model, uint8_t b0, uint8_t b1) {
     return humidity;
 }
 
+static uint32_t get_measurement_timeout_us(dht_model_t model) {
+    return get_start_pulse_duration_us(model) + DHT_MEASUREMENT_TIMEOUT_US;
+}
+
+// stops the state machine and collects the bytes its DMA channel did not
+// transfer, which happens when a chain was cut short by another sensor's timeout
+static dht_result_t complete_measurement(dht_t *dht) {
+    pio_sm_set_enabled(dht->pio, dht->sm, false);
+    // make sure pin is left in hi-z mode
+    pio_sm_exec(dht->pio, dht->sm, pio_encode_set(pio_pindirs, 0));
+
+    // the write address, unlike the transfer count, is reloaded even for a
+    // chained channel that was never triggered
+    uint received = dma_channel_hw_addr(dht->dma_chan)->write_addr - (uintptr_t)dht->data;
+    while (received < DHT_FRAME_SIZE && !pio_sm_is_rx_fifo_empty(dht->pio, dht->sm)) {
+        dht->data[received++] = (uint8_t)pio_sm_get(dht->pio, dht->sm);
+    }
+    if (received < DHT_FRAME_SIZE) {
+        return DHT_RESULT_TIMEOUT;
+    }
+    uint8_t checksum = dht->data[0] + dht->data[1] + dht->data[2] + dht->data[3];
+    if (dht->data[4] != checksum) {
+        return DHT_RESULT_BAD_CHECKSUM;
+    }
+    // an all-zero frame passes the checksum but is a line held low, not a reading
+    if ((dht->data[0] | dht->data[1] | dht->data[2] | dht->data[3]) == 0) {
+        return DHT_RESULT_BAD_CHECKSUM;
+    }
+    dht->humidity_permille = decode_humidity(dht->model, dht->data[0], dht->data[1]);
+    dht->temperature_centi_c = decode_temperature(dht->model, dht->data[2], dht->data[3]);
+    return DHT_RESULT_OK;
+}
+
+static void finish_measurement(dht_t *dht) {
+    dma_irq_targets[dht->dma_chan].dht = NULL;
+    // aborting a channel may raise a spurious completion IRQ (RP2040-E13)
+    dma_channel_set_irq0_enabled(dht->dma_chan, false);
+    abort_dma_channels(1u << dht->dma_chan);
+    dht->result = complete_measurement(dht);
+    dma_channel_acknowledge_irq0(dht->dma_chan);
+    dht->done = true;
+    if (dht->callback != NULL) {
+        dht->callback(dht, dht->result, dht->user_data);
+    }
+}
+
+static void finish_group_measurement(dht_group_t *group) {
+    uint last_chan = group->sensors[group->count - 1]->dma_chan;
+    uint32_t dma_mask = 0;
+
+    for (uint i = 0; i < group->count; i++) {
+        dma_mask |= 1u << group->sensors[i]->dma_chan;
+    }
+
+    dma_irq_targets[last_chan].group = NULL;
+    dma_channel_set_irq0_enabled(last_chan, false);
+    abort_dma_channels(dma_mask);
+    for (uint i = 0; i < group->count; i++) {
+        dht_t *dht = group->sensors[i];
+        dht->result = complete_measurement(dht);
+        dht->done = true;
+    }
+    dma_channel_acknowledge_irq0(last_chan);
+    group->done = true;
+    if (group->callback != NULL) {
+        group->callback(group, group->user_data);
+    }
+}
+
+// shared by all sensors and groups; runs at the same priority as the timer IRQ
+// so the completion and timeout paths never preempt each other
+static void dma_irq_handler(void) {
+    for (uint chan = 0; chan < NUM_DMA_CHANNELS; chan++) {
+        dma_irq_target_t *target = &dma_irq_targets[chan];
+        if ((target->dht == NULL && target->group == NULL) || !dma_channel_get_irq0_status(chan)) {
+            continue;
+        }
+        dma_channel_acknowledge_irq0(chan);
+        if (target->dht != NULL) {
+            cancel_alarm(target->dht->timeout_alarm);
+            finish_measurement(target->dht);
+        } else {
+            cancel_alarm(target->group->timeout_alarm);
+            finish_group_measurement(target->group);
+        }
+    }
+}
+
+static int64_t timeout_callback(alarm_id_t id, void *user_data) {
+    dht_t *dht = (dht_t *)user_data;
+    if (dma_irq_targets[dht->dma_chan].dht == dht) {
+        finish_measurement(dht);
+    }
+    return 0;
+}
+
+static int64_t group_timeout_callback(alarm_id_t id, void *user_data) {
+    dht_group_t *group = (dht_group_t *)user_data;
+    if (!group->done) {
+        finish_group_measurement(group);
+    }
+    return 0;
+}
+
+static void wait_until_done(volatile bool *done) {
+    // sleep until the DMA or timeout interrupt completes the measurement;
+    // WFI wakes on a pending interrupt even while interrupts are masked
+    uint32_t irq_state = save_and_disable_interrupts();
+    while (!*done) {
+        __wfi();
+        restore_interrupts(irq_state);
+        irq_state = save_and_disable_interrupts();
+    }
+    restore_interrupts(irq_state);
+}
+
 //
 // public interface
 //
@@ -123,13 +268,25 @@ static float decode_humidity(dht_model_t model, uint8_t b0, uint8_t b1) {
 void dht_init(dht_t *dht, dht_model_t model, PIO pio, uint8_t data_pin, bool pull_up) {
     assert(pio == pio0 || pio == pio1);
 
+    uint pio_index = pio_get_index(pio);
+    if (program_users[pio_index]++ == 0) {
+        program_offsets[pio_index] = pio_add_program(pio, &dht_program);
+    }
+
     memset(dht, 0, sizeof(dht_t));
     dht->model = model;
     dht->pio = pio;
-    dht->pio_program_offset = pio_add_program(pio, &dht_program);
+    dht->pio_program_offset = program_offsets[pio_index];
     dht->sm = pio_claim_unused_sm(pio, true /* required */);
     dht->dma_chan = dma_claim_unused_channel(true /* required */);
     dht->data_pin = data_pin;
+    dht->done = true;
+
+    if (!dma_irq_handler_installed) {
+        irq_add_shared_handler(DMA_IRQ_0, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+        dma_irq_handler_installed = true;
+    }
 
     pio_gpio_init(pio, data_pin);
     gpio_set_pulls(data_pin, pull_up, false /* down */);
@@ -137,54 +294,130 @@ void dht_init(dht_t *dht, dht_model_t model, PIO pio, uint8_t data_pin, bool pul
 
 void dht_deinit(dht_t *dht) {
     assert(dht->pio != NULL); // not initialized
+    assert(dht->done); // a group measurement is still in progress
 
+    if (dma_irq_targets[dht->dma_chan].dht == dht) {
+        dma_irq_targets[dht->dma_chan].dht = NULL;
+        cancel_alarm(dht->timeout_alarm);
+    }
+    dma_channel_set_irq0_enabled(dht->dma_chan, false);
     dma_channel_abort(dht->dma_chan);
+    dma_channel_acknowledge_irq0(dht->dma_chan);
     dma_channel_unclaim(dht->dma_chan);
 
     pio_sm_set_enabled(dht->pio, dht->sm, false);
     // make sure pin is left in hi-z mode; original pin function & pulls are not restored
     pio_sm_set_consecutive_pindirs(dht->pio, dht->sm, dht->data_pin, 1, false /* is_out */);
     pio_sm_unclaim(dht->pio, dht->sm);
-    pio_remove_program(dht->pio, &dht_program, dht->pio_program_offset);
+    if (--program_users[pio_get_index(dht->pio)] == 0) {
+        pio_remove_program(dht->pio, &dht_program, dht->pio_program_offset);
+    }
 
     dht->pio = NULL;
 }
 
 void dht_start_measurement(dht_t *dht) {
+    dht_start_measurement_async(dht, NULL, NULL);
+}
+
+void dht_start_measurement_async(dht_t *dht, dht_callback_t callback, void *user_data) {
     assert(dht->pio != NULL); // not initialized
-    assert(!pio_sm_is_enabled(dht->pio, dht->sm)); // another measurement in progress
+    assert(dht->done && !pio_sm_is_enabled(dht->pio, dht->sm)); // another measurement in progress
+
+    dht->callback = callback;
+    dht->user_data = user_data;
+    dht->done = false;
+    dma_irq_targets[dht->dma_chan].dht = dht;
 
     memset(dht->data, 0, sizeof(dht->data));
-    configure_dma_channel(dht->dma_chan, dht->pio, dht->sm, dht->data);
+    dma_channel_acknowledge_irq0(dht->dma_chan);
+    dma_channel_set_irq0_enabled(dht->dma_chan, true);
+    configure_dma_channel(dht->dma_chan, dht->pio, dht->sm, dht->data, dht->dma_chan /* no chaining */, true, true);
     dht_program_init(dht->pio, dht->sm, dht->pio_program_offset, dht->model, dht->data_pin);
+    pio_sm_set_enabled(dht->pio, dht->sm, true);
     dht->start_time = time_us_32();
+
+    dht->timeout_alarm = add_alarm_in_us(get_measurement_timeout_us(dht->model), timeout_callback, dht, true);
+    assert(dht->timeout_alarm > 0);
 }
 
 dht_result_t dht_finish_measurement_blocking(dht_t *dht, float *humidity, float *temperature_c) {
     assert(dht->pio != NULL); // not initialized
-    assert(pio_sm_is_enabled(dht->pio, dht->sm)); // no measurement in progress
 
-    uint32_t timeout = get_start_pulse_duration_us(dht->model) + DHT_MEASUREMENT_TIMEOUT_US;
-    while (dma_channel_is_busy(dht->dma_chan) && time_us_32() - dht->start_time < timeout) {
-        tight_loop_contents();
-    }
-    pio_sm_set_enabled(dht->pio, dht->sm, false);
-    // make sure pin is left in hi-z mode
-    pio_sm_exec(dht->pio, dht->sm, pio_encode_set(pio_pindirs, 0));
+    wait_until_done(&dht->done);
 
-    if (dma_channel_is_busy(dht->dma_chan)) {
-        dma_channel_abort(dht->dma_chan);
-        return DHT_RESULT_TIMEOUT;
-    }
-    uint8_t checksum = dht->data[0] + dht->data[1] + dht->data[2] + dht->data[3];
-    if (dht->data[4] != checksum) {
-        return DHT_RESULT_BAD_CHECKSUM;
+    if (dht->result == DHT_RESULT_OK) {
+        if (humidity != NULL) {
+            *humidity = dht->humidity_permille / 10.0f;
+        }
+        if (temperature_c != NULL) {
+            *temperature_c = dht->temperature_centi_c / 100.0f;
+        }
     }
-    if (humidity != NULL) {
-        *humidity = decode_humidity(dht->model, dht->data[0], dht->data[1]);
+    return dht->result;
+}
+
+void dht_group_init(dht_group_t *group, PIO pio) {
+    assert(pio == pio0 || pio == pio1);
+
+    memset(group, 0, sizeof(dht_group_t));
+    group->pio = pio;
+    group->done = true;
+}
+
+void dht_group_add(dht_group_t *group, dht_t *dht) {
+    assert(dht->pio == group->pio); // sensor must be initialized on the group's PIO block
+    assert(group->count < DHT_GROUP_MAX_SENSORS);
+    assert(group->done);
+
+    group->sensors[group->count++] = dht;
+}
+
+void dht_group_start_measurement_async(dht_group_t *group, dht_group_callback_t callback, void *user_data) {
+    assert(group->count > 0);
+    assert(group->done); // another measurement in progress
+
+    uint32_t sm_mask = 0;
+    uint32_t timeout_us = 0;
+    dht_t *last = group->sensors[group->count - 1];
+
+    group->callback = callback;
+    group->user_data = user_data;
+    group->done = false;
+    dma_irq_targets[last->dma_chan].group = group;
+    dma_channel_acknowledge_irq0(last->dma_chan);
+    dma_channel_set_irq0_enabled(last->dma_chan, true);
+
+    for (uint i = 0; i < group->count; i++) {
+        dht_t *dht = group->sensors[i];
+        assert(dht->done && !pio_sm_is_enabled(dht->pio, dht->sm)); // sensor busy on its own
+
+        bool is_last = dht == last;
+        dht->callback = NULL;
+        dht->done = false;
+        memset(dht->data, 0, sizeof(dht->data));
+        // each channel hands over to the next once its frame is in; only the
+        // first is triggered now and only the last raises the completion IRQ
+        configure_dma_channel(dht->dma_chan, dht->pio, dht->sm, dht->data,
+                              is_last ? dht->dma_chan : group->sensors[i + 1]->dma_chan, is_last, i == 0);
+        dht_program_init(dht->pio, dht->sm, dht->pio_program_offset, dht->model, dht->data_pin);
+
+        sm_mask |= 1u << dht->sm;
+        if (get_measurement_timeout_us(dht->model) > timeout_us) {
+            timeout_us = get_measurement_timeout_us(dht->model);
+        }
     }
-    if (temperature_c != NULL) {
-        *temperature_c = decode_temperature(dht->model, dht->data[2], dht->data[3]);
+
+    pio_enable_sm_mask_in_sync(group->pio, sm_mask);
+    uint32_t start_time = time_us_32();
+    for (uint i = 0; i < group->count; i++) {
+        group->sensors[i]->start_time = start_time;
     }
-    return DHT_RESULT_OK;
+
+    group->timeout_alarm = add_alarm_in_us(timeout_us, group_timeout_callback, group, true);
+    assert(group->timeout_alarm > 0);
+}
+
+void dht_group_finish_measurement_blocking(dht_group_t *group) {
+    wait_until_done(&group->done);
 }
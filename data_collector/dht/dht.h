@@ -8,6 +8,7 @@
 #define _DHT_H_
 
 #include <hardware/pio.h>
+#include <pico/time.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -29,6 +30,25 @@ typedef enum dht_model_t {
     DHT22,
 } dht_model_t;
 
+/**
+ * \brief Measurement result.
+ */
+typedef enum dht_result_t {
+    DHT_RESULT_OK, /**< No error.*/
+    DHT_RESULT_TIMEOUT, /**< DHT sensor not reponding. */
+    DHT_RESULT_BAD_CHECKSUM, /**< Sensor data doesn't match checksum, or is all zero. */
+} dht_result_t;
+
+struct dht_t;
+
+/**
+ * \brief Measurement completion callback.
+ *
+ * Called from interrupt context. On success the decoded values are available
+ * in the humidity_permille and temperature_centi_c fields of the sensor.
+ */
+typedef void (*dht_callback_t)(struct dht_t *dht, dht_result_t result, void *user_data);
+
 /**
  * \brief DHT sensor.
  */
@@ -41,22 +61,21 @@ typedef struct dht_t {
     uint8_t data_pin;
     uint8_t data[5];
     uint32_t start_time;
+    dht_callback_t callback;
+    void *user_data;
+    alarm_id_t timeout_alarm;
+    volatile bool done;
+    dht_result_t result;
+    uint16_t humidity_permille;
+    int16_t temperature_centi_c;
 } dht_t;
 
-/**
- * \brief Measurement result.
- */
-typedef enum dht_result_t {
-    DHT_RESULT_OK, /**< No error.*/
-    DHT_RESULT_TIMEOUT, /**< DHT sensor not reponding. */
-    DHT_RESULT_BAD_CHECKSUM, /**< Sensor data doesn't match checksum. */
-} dht_result_t;
-
 /**
  * \brief Initialize DHT sensor.
  * 
  * The library claims one state machine from the given PIO instance, and one DMA
- * channel to communicate with the sensor.
+ * channel to communicate with the sensor. Sensors on the same PIO block share
+ * one copy of the program, so up to four can be driven by a single block.
  * 
  * \param dht DHT sensor.
  * \param model DHT sensor model.
@@ -77,7 +96,8 @@ void dht_deinit(dht_t *dht);
  * \brief Start asynchronous measurement.
  *
  * The measurement runs in the background, and may take up to 25ms depending
- * on DHT model.
+ * on DHT model. Completion is signalled by a DMA interrupt, with a timer
+ * alarm for the timeout.
  * 
  * DHT sensors typically need at least 2 seconds between measurements for
  * accurate results.
@@ -86,9 +106,24 @@ void dht_deinit(dht_t *dht);
  */
 void dht_start_measurement(dht_t *dht);
 
+/**
+ * \brief Start asynchronous measurement with a completion callback.
+ *
+ * The callback runs from the DMA interrupt when the transfer completes, or
+ * from a timer alarm if the sensor does not respond. All sensors share one
+ * completion handler, so any number of them can be measured concurrently.
+ *
+ * \param dht DHT sensor.
+ * \param callback Completion callback.
+ * \param user_data Passed to the callback.
+ */
+void dht_start_measurement_async(dht_t *dht, dht_callback_t callback, void *user_data);
+
 /**
  * \brief Wait for measurement to complete and get the result.
  *
+ * The core sleeps (WFI) until the measurement completes or times out.
+ *
  * \param dht DHT sensor.
  * \param[out] humidity Relative humidity. May be NULL.
  * \param[out] temperature_c Degrees Celsius. May be NULL.
@@ -96,6 +131,74 @@ void dht_start_measurement(dht_t *dht);
  */
 dht_result_t dht_finish_measurement_blocking(dht_t *dht, float *humidity, float *temperature_c);
 
+/** Sensors per group, one for each state machine of a PIO block. */
+#define DHT_GROUP_MAX_SENSORS 4
+
+struct dht_group_t;
+
+/**
+ * \brief Group measurement completion callback.
+ *
+ * Called from interrupt context once every sensor in the group has finished.
+ * Per-sensor results are in the result, humidity_permille and
+ * temperature_centi_c fields.
+ */
+typedef void (*dht_group_callback_t)(struct dht_group_t *group, void *user_data);
+
+/**
+ * \brief Sensors on one PIO block that are measured together.
+ */
+typedef struct dht_group_t {
+    PIO pio;
+    dht_t *sensors[DHT_GROUP_MAX_SENSORS];
+    uint8_t count;
+    dht_group_callback_t callback;
+    void *user_data;
+    alarm_id_t timeout_alarm;
+    volatile bool done;
+} dht_group_t;
+
+/**
+ * \brief Initialize an empty sensor group.
+ *
+ * \param group Sensor group.
+ * \param pio PIO block shared by the sensors (pio0 or pio1).
+ */
+void dht_group_init(dht_group_t *group, PIO pio);
+
+/**
+ * \brief Add a sensor to a group.
+ *
+ * \param group Sensor group.
+ * \param dht DHT sensor, initialized on the group's PIO block.
+ */
+void dht_group_add(dht_group_t *group, dht_t *dht);
+
+/**
+ * \brief Start measuring all sensors of a group.
+ *
+ * The state machines are enabled in the same cycle, so the sensors reply in
+ * parallel. Their DMA channels are chained: each one starts the next after
+ * reading its 5-byte frame, which the joined RX FIFO buffers in the meantime.
+ * Only the last channel raises an interrupt, and a single timer alarm covers
+ * the whole group. Sensors that did not respond get DHT_RESULT_TIMEOUT.
+ *
+ * Individual sensors of the group may still be measured on their own with
+ * dht_start_measurement_async() while the group is idle.
+ *
+ * \param group Sensor group.
+ * \param callback Completion callback. May be NULL.
+ * \param user_data Passed to the callback.
+ */
+void dht_group_start_measurement_async(dht_group_t *group, dht_group_callback_t callback, void *user_data);
+
+/**
+ * \brief Wait for a group measurement to complete.
+ *
+ * \param group Sensor group.
+ */
+void dht_group_finish_measurement_blocking(dht_group_t *group);
+
 #ifdef __cplusplus
 }
 #endif
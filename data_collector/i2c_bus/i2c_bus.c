@@ -0,0 +1,284 @@
+#include <i2c_bus.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+static const uint RECOVERY_CLOCKS = 9;
+static const uint RECOVERY_HALF_PERIOD_US = 5; // 100kHz
+static const uint RX_DRAIN_SPINS = 1000;
+
+static i2c_bus_t *buses[NUM_I2CS];
+
+//
+// misc
+//
+
+static void configure_controller(i2c_bus_t *bus) {
+    i2c_hw_t *hw = i2c_get_hw(bus->i2c);
+
+    i2c_init(bus->i2c, bus->baudrate);
+    // DMA is paced by the FIFO levels: refill TX at half empty, drain RX per byte
+    hw->dma_tdlr = 8;
+    hw->dma_rdlr = 0;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+}
+
+// drive an open-drain line low, or release it to the pull-up
+static void set_line(uint pin, bool high) {
+    gpio_set_dir(pin, high ? GPIO_IN : GPIO_OUT);
+    busy_wait_us_32(RECOVERY_HALF_PERIOD_US);
+}
+
+static bool recover_lines(i2c_bus_t *bus) {
+    gpio_put(bus->sda_pin, false);
+    gpio_put(bus->scl_pin, false);
+    gpio_set_dir(bus->sda_pin, GPIO_IN);
+    gpio_set_dir(bus->scl_pin, GPIO_IN);
+    gpio_set_function(bus->sda_pin, GPIO_FUNC_SIO);
+    gpio_set_function(bus->scl_pin, GPIO_FUNC_SIO);
+    busy_wait_us_32(RECOVERY_HALF_PERIOD_US);
+
+    // a device stuck mid-byte releases SDA once it has clocked out its bits
+    for (uint i = 0; i < RECOVERY_CLOCKS && !gpio_get(bus->sda_pin); i++) {
+        set_line(bus->scl_pin, false);
+        set_line(bus->scl_pin, true);
+    }
+    // STOP: SDA rises while SCL is high
+    set_line(bus->scl_pin, false);
+    set_line(bus->sda_pin, false);
+    set_line(bus->scl_pin, true);
+    set_line(bus->sda_pin, true);
+
+    bool ok = gpio_get(bus->sda_pin) && gpio_get(bus->scl_pin);
+    gpio_set_function(bus->sda_pin, GPIO_FUNC_I2C);
+    gpio_set_function(bus->scl_pin, GPIO_FUNC_I2C);
+    bus->recoveries++;
+    return ok;
+}
+
+static uint build_commands(i2c_bus_t *bus, const i2c_transaction_t *t) {
+    uint count = 0;
+
+    for (uint i = 0; i < t->tx_len; i++) {
+        bus->commands[count++] = t->tx[i];
+    }
+    for (uint i = 0; i < t->rx_len; i++) {
+        uint32_t cmd = I2C_IC_DATA_CMD_CMD_BITS;
+        if (i == 0 && t->tx_len > 0) {
+            cmd |= I2C_IC_DATA_CMD_RESTART_BITS;
+        }
+        bus->commands[count++] = cmd;
+    }
+    bus->commands[count - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+    return count;
+}
+
+static int64_t timeout_callback(alarm_id_t id, void *user_data);
+
+static void start_transaction(i2c_bus_t *bus) {
+    i2c_transaction_t *t = bus->head;
+    i2c_hw_t *hw = i2c_get_hw(bus->i2c);
+    uint count = build_commands(bus, t);
+
+    // the target address can only be changed while the controller is disabled
+    hw->enable = 0;
+    hw->tar = t->addr;
+    hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+    bus->abort_source = 0;
+
+    if (t->rx_len > 0) {
+        dma_channel_config c = dma_channel_get_default_config(bus->rx_dma_chan);
+        channel_config_set_dreq(&c, i2c_get_dreq(bus->i2c, false /* is_tx */));
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        dma_channel_configure(bus->rx_dma_chan, &c, t->rx, &hw->data_cmd, t->rx_len, true);
+    }
+
+    dma_channel_config c = dma_channel_get_default_config(bus->tx_dma_chan);
+    channel_config_set_dreq(&c, i2c_get_dreq(bus->i2c, true /* is_tx */));
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(bus->tx_dma_chan, &c, &hw->data_cmd, bus->commands, count, true);
+
+    bus->timeout_alarm = add_alarm_in_us(t->timeout_us, timeout_callback, bus, true);
+}
+
+static void complete_transaction(i2c_bus_t *bus, i2c_bus_result_t result) {
+    i2c_transaction_t *t = bus->head;
+
+    bus->head = t->next;
+    if (bus->head == NULL) {
+        bus->tail = NULL;
+    }
+
+    t->next = NULL;
+    t->result = result;
+    t->done = true;
+    if (t->callback != NULL) {
+        t->callback(t, result, t->user_data);
+    }
+
+    if (bus->head != NULL) {
+        start_transaction(bus);
+    }
+}
+
+static i2c_bus_result_t get_abort_result(uint32_t abort_source) {
+    if (abort_source == 0) {
+        return I2C_BUS_RESULT_OK;
+    }
+    if (abort_source & (I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS | I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS)) {
+        return I2C_BUS_RESULT_NACK;
+    }
+    return I2C_BUS_RESULT_ERROR;
+}
+
+static void handle_irq(i2c_bus_t *bus) {
+    i2c_hw_t *hw = i2c_get_hw(bus->i2c);
+    uint32_t status = hw->intr_stat;
+
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // the controller flushed its FIFOs and sends STOP, finish on STOP_DET
+        bus->abort_source = hw->tx_abrt_source;
+        dma_channel_abort(bus->tx_dma_chan);
+        dma_channel_abort(bus->rx_dma_chan);
+        (void)hw->clr_tx_abrt;
+    }
+
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void)hw->clr_stop_det;
+        if (bus->head == NULL) {
+            return;
+        }
+        cancel_alarm(bus->timeout_alarm);
+
+        i2c_bus_result_t result = get_abort_result(bus->abort_source);
+        if (result == I2C_BUS_RESULT_OK) {
+            // the last byte arrives just before STOP, give DMA a moment to move it
+            for (uint i = 0; i < RX_DRAIN_SPINS && dma_channel_is_busy(bus->rx_dma_chan); i++) {
+                tight_loop_contents();
+            }
+            if (dma_channel_is_busy(bus->rx_dma_chan)) {
+                dma_channel_abort(bus->rx_dma_chan);
+                result = I2C_BUS_RESULT_ERROR;
+            }
+        }
+        complete_transaction(bus, result);
+    }
+}
+
+// runs at the same priority as the timer IRQ, so the completion and timeout
+// paths never preempt each other
+static void i2c_bus_irq_handler(void) {
+    for (uint i = 0; i < NUM_I2CS; i++) {
+        if (buses[i] != NULL) {
+            handle_irq(buses[i]);
+        }
+    }
+}
+
+static int64_t timeout_callback(alarm_id_t id, void *user_data) {
+    i2c_bus_t *bus = (i2c_bus_t *)user_data;
+
+    if (bus->head == NULL) {
+        return 0;
+    }
+
+    dma_channel_abort(bus->tx_dma_chan);
+    dma_channel_abort(bus->rx_dma_chan);
+    // reset the controller, a device may still be holding SDA low
+    i2c_deinit(bus->i2c);
+    recover_lines(bus);
+    configure_controller(bus);
+
+    bus->timeouts++;
+    complete_transaction(bus, I2C_BUS_RESULT_TIMEOUT);
+    return 0;
+}
+
+//
+// public interface
+//
+
+void i2c_bus_init(i2c_bus_t *bus, i2c_inst_t *i2c, uint sda_pin, uint scl_pin, uint baudrate) {
+    uint index = i2c_hw_index(i2c);
+    assert(buses[index] == NULL); // one bus per I2C instance
+
+    memset(bus, 0, sizeof(i2c_bus_t));
+    bus->i2c = i2c;
+    bus->sda_pin = sda_pin;
+    bus->scl_pin = scl_pin;
+    bus->baudrate = baudrate;
+    bus->tx_dma_chan = dma_claim_unused_channel(true /* required */);
+    bus->rx_dma_chan = dma_claim_unused_channel(true /* required */);
+
+    gpio_pull_up(sda_pin);
+    gpio_pull_up(scl_pin);
+    gpio_init(sda_pin);
+    gpio_init(scl_pin);
+    if (!gpio_get(sda_pin)) {
+        recover_lines(bus);
+    }
+    gpio_set_function(sda_pin, GPIO_FUNC_I2C);
+    gpio_set_function(scl_pin, GPIO_FUNC_I2C);
+    configure_controller(bus);
+
+    buses[index] = bus;
+    uint irq = index == 0 ? I2C0_IRQ : I2C1_IRQ;
+    irq_set_exclusive_handler(irq, i2c_bus_irq_handler);
+    irq_set_enabled(irq, true);
+}
+
+void i2c_bus_set_baudrate(i2c_bus_t *bus, uint baudrate) {
+    assert(bus->head == NULL); // transactions in progress
+
+    bus->baudrate = baudrate;
+    i2c_set_baudrate(bus->i2c, baudrate);
+}
+
+void i2c_bus_submit(i2c_bus_t *bus, i2c_transaction_t *transaction, i2c_transaction_callback_t callback, void *user_data) {
+    assert(transaction->tx_len + transaction->rx_len > 0);
+    assert(transaction->tx_len + transaction->rx_len <= I2C_BUS_MAX_COMMANDS);
+
+    transaction->callback = callback;
+    transaction->user_data = user_data;
+    transaction->done = false;
+    transaction->next = NULL;
+
+    uint32_t irq_state = save_and_disable_interrupts();
+    if (bus->tail != NULL) {
+        bus->tail->next = transaction;
+        bus->tail = transaction;
+    } else {
+        bus->head = transaction;
+        bus->tail = transaction;
+        start_transaction(bus);
+    }
+    restore_interrupts(irq_state);
+}
+
+i2c_bus_result_t i2c_bus_transfer_blocking(i2c_bus_t *bus, i2c_transaction_t *transaction) {
+    i2c_bus_submit(bus, transaction, NULL, NULL);
+
+    // sleep until the I2C or timeout interrupt completes the transaction;
+    // WFI wakes on a pending interrupt even while interrupts are masked
+    uint32_t irq_state = save_and_disable_interrupts();
+    while (!transaction->done) {
+        __wfi();
+        restore_interrupts(irq_state);
+        irq_state = save_and_disable_interrupts();
+    }
+    restore_interrupts(irq_state);
+
+    return transaction->result;
+}
+
+bool i2c_bus_recover(i2c_bus_t *bus) {
+    return recover_lines(bus);
+}
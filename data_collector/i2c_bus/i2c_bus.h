@@ -0,0 +1,148 @@
+#ifndef _I2C_BUS_H_
+#define _I2C_BUS_H_
+
+#include <hardware/i2c.h>
+#include <pico/time.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file i2c_bus.h
+ *
+ * \brief Queued, DMA driven I2C bus manager.
+ */
+
+#define I2C_BUS_STANDARD_MODE 100000
+#define I2C_BUS_FAST_MODE 400000
+#define I2C_BUS_FAST_MODE_PLUS 1000000
+
+/** Longest transaction: register pointer and data, or the read commands. */
+#define I2C_BUS_MAX_COMMANDS 32
+
+/**
+ * \brief Transaction result.
+ */
+typedef enum i2c_bus_result_t {
+    I2C_BUS_RESULT_OK, /**< No error. */
+    I2C_BUS_RESULT_NACK, /**< Address or data not acknowledged. */
+    I2C_BUS_RESULT_TIMEOUT, /**< Transaction did not finish in time, the bus was recovered. */
+    I2C_BUS_RESULT_ERROR, /**< Other abort, e.g. lost arbitration. */
+} i2c_bus_result_t;
+
+struct i2c_transaction_t;
+
+/**
+ * \brief Transaction completion callback.
+ *
+ * Called from interrupt context. The next queued transaction has not been
+ * started yet, so the callback may submit follow-up transactions.
+ */
+typedef void (*i2c_transaction_callback_t)(struct i2c_transaction_t *transaction, i2c_bus_result_t result, void *user_data);
+
+/**
+ * \brief I2C transaction: an optional write followed by an optional read.
+ *
+ * When both are given, the read starts with a repeated start. The structure
+ * and buffers must stay valid until the transaction is done.
+ */
+typedef struct i2c_transaction_t {
+    uint8_t addr;
+    const uint8_t *tx;
+    uint16_t tx_len;
+    uint8_t *rx;
+    uint16_t rx_len;
+    uint32_t timeout_us;
+    i2c_transaction_callback_t callback;
+    void *user_data;
+    volatile bool done;
+    i2c_bus_result_t result;
+    struct i2c_transaction_t *next;
+} i2c_transaction_t;
+
+/**
+ * \brief I2C bus with its transaction queue.
+ */
+typedef struct i2c_bus_t {
+    i2c_inst_t *i2c;
+    uint8_t sda_pin;
+    uint8_t scl_pin;
+    uint8_t tx_dma_chan;
+    uint8_t rx_dma_chan;
+    uint baudrate;
+    i2c_transaction_t *head;
+    i2c_transaction_t *tail;
+    alarm_id_t timeout_alarm;
+    uint32_t abort_source;
+    uint32_t commands[I2C_BUS_MAX_COMMANDS];
+    uint32_t timeouts;
+    uint32_t recoveries;
+} i2c_bus_t;
+
+/**
+ * \brief Initialize an I2C bus.
+ *
+ * Claims the I2C instance interrupt and two DMA channels. A bus held low by
+ * a device is recovered before the controller is enabled.
+ *
+ * \param bus I2C bus.
+ * \param i2c I2C instance (i2c0 or i2c1).
+ * \param sda_pin SDA pin.
+ * \param scl_pin SCL pin.
+ * \param baudrate Bus speed, e.g. I2C_BUS_FAST_MODE.
+ */
+void i2c_bus_init(i2c_bus_t *bus, i2c_inst_t *i2c, uint sda_pin, uint scl_pin, uint baudrate);
+
+/**
+ * \brief Change the bus speed.
+ *
+ * Must only be called while the queue is empty.
+ *
+ * \param bus I2C bus.
+ * \param baudrate Bus speed, e.g. I2C_BUS_FAST_MODE_PLUS.
+ */
+void i2c_bus_set_baudrate(i2c_bus_t *bus, uint baudrate);
+
+/**
+ * \brief Queue a transaction.
+ *
+ * Transactions run back to back in submission order. The command stream and
+ * the received bytes are moved by DMA; completion is signalled by the I2C
+ * interrupt on STOP, with a timer alarm for the timeout.
+ *
+ * \param bus I2C bus.
+ * \param transaction Transaction to run.
+ * \param callback Completion callback. May be NULL.
+ * \param user_data Passed to the callback.
+ */
+void i2c_bus_submit(i2c_bus_t *bus, i2c_transaction_t *transaction, i2c_transaction_callback_t callback, void *user_data);
+
+/**
+ * \brief Queue a transaction and wait for it to complete.
+ *
+ * The core sleeps (WFI) until the transaction is done. Must not be called
+ * from interrupt context.
+ *
+ * \param bus I2C bus.
+ * \param transaction Transaction to run.
+ * \return Result status.
+ */
+i2c_bus_result_t i2c_bus_transfer_blocking(i2c_bus_t *bus, i2c_transaction_t *transaction);
+
+/**
+ * \brief Free a bus held low by a device.
+ *
+ * Clocks SCL until the device releases SDA, at most 9 times, then issues a
+ * STOP condition. The I2C controller must not be using the pins.
+ *
+ * \param bus I2C bus.
+ * \return Whether both lines are high afterwards.
+ */
+bool i2c_bus_recover(i2c_bus_t *bus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _I2C_BUS_H_
@@ -73,6 +73,12 @@ static uint8_t a_ina219_iic_read(ina219_handle_t *handle, uint8_t reg, uint16_t
 {
     uint8_t buf[2];
     
+    if ((reg == INA219_REG_CONF) && (handle->conf_cached != 0))                 /* config is only changed by us */
+    {
+        *data = handle->conf;                                                   /* get cached data */
+        
+        return 0;                                                               /* success return 0 */
+    }
     memset(buf, 0, sizeof(uint8_t) * 2);                                        /* clear the buffer */
     if (handle->iic_read(handle->iic_addr, reg, (uint8_t *)buf, 2) != 0)        /* read data */
     {
@@ -81,6 +87,11 @@ static uint8_t a_ina219_iic_read(ina219_handle_t *handle, uint8_t reg, uint16_t
     else
     {
         *data = (uint16_t)buf[0] << 8 | buf[1];                                 /* get data */
+        if (reg == INA219_REG_CONF)                                             /* check config */
+        {
+            handle->conf = *data;                                               /* cache config */
+            handle->conf_cached = 1;                                            /* flag cached */
+        }
         
         return 0;                                                               /* success return 0 */
     }
@@ -104,14 +115,67 @@ static uint8_t a_ina219_iic_write(ina219_handle_t *handle, uint8_t reg, uint16_t
     buf[1] = (uint8_t)((data >> 0) & 0xFF);                                      /* get LSB */
     if (handle->iic_write(handle->iic_addr, reg, (uint8_t *)buf, 2) != 0)        /* write data */
     {
+        if (reg == INA219_REG_CONF)                                              /* check config */
+        {
+            handle->conf_cached = 0;                                             /* state unknown */
+        }
+        
         return 1;                                                                /* return error */
     }
     else
     {
+        if (reg == INA219_REG_CONF)                                              /* check config */
+        {
+            handle->conf = data;                                                 /* cache config */
+            handle->conf_cached = ((data & (1 << 15)) == 0) ? 1 : 0;             /* a reset restores defaults */
+        }
+        
         return 0;                                                                /* success return 0 */
     }
 }
 
+/**
+ * @brief      read the shunt voltage register
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[out] *current points to a current register buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ * @note       the current register value is computed with the chip's own
+ *             equation from the shunt voltage and the cached calibration
+ */
+static uint8_t a_ina219_read_shunt_raw(ina219_handle_t *handle, int32_t *current)
+{
+    uint8_t res;
+    union
+    {
+        uint16_t u;
+        int16_t s;
+    } shunt;
+   
+    if (handle == NULL)                                                               /* check handle */
+    {
+        return 2;                                                                     /* return error */
+    }
+    if (handle->inited != 1)                                                          /* check handle initialization */
+    {
+        return 3;                                                                     /* return error */
+    }
+    
+    res = a_ina219_iic_read(handle, INA219_REG_SHUNT_VOLTAGE, (uint16_t *)&shunt.u);  /* read shunt voltage */
+    if (res != 0)                                                                     /* check result */
+    {
+        handle->debug_print("ina219: read shunt voltage register failed.\n");         /* read shunt voltage register failed */
+       
+        return 1;                                                                     /* return error */
+    }
+    *current = ((int32_t)shunt.s * handle->calibration) / 4096;                       /* current register equation */
+    
+    return 0;                                                                         /* success return 0 */
+}
+
 /**
  * @brief     set the resistance
  * @param[in] *handle points to an ina219 handle structure
@@ -812,6 +876,119 @@ uint8_t ina219_read_power(ina219_handle_t *handle, uint16_t *raw, float *mW)
     return 0;                                                                   /* success return 0 */
 }
 
+/**
+ * @brief      get the conversion ready flag
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[out] *ready points to a flag buffer, 1 once a triggered conversion has completed
+ * @param[out] *bus points to a bus voltage buffer, in 4 mV steps
+ * @return     status code
+ *             - 0 success
+ *             - 1 get conversion ready failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ *             - 4 math overflow
+ * @note       the flag is cleared by reading the power register or writing the config register,
+ *             the flag shares the bus voltage register so the poll returns the voltage too
+ */
+uint8_t ina219_get_conversion_ready(ina219_handle_t *handle, uint8_t *ready, uint16_t *bus)
+{
+    uint8_t res;
+    uint16_t raw;
+   
+    if (handle == NULL)                                                         /* check handle */
+    {
+        return 2;                                                               /* return error */
+    }
+    if (handle->inited != 1)                                                    /* check handle initialization */
+    {
+        return 3;                                                               /* return error */
+    }
+    
+    res = a_ina219_iic_read(handle, INA219_REG_BUS_VOLTAGE, (uint16_t *)&raw);  /* read bus voltage */
+    if (res != 0)                                                               /* check result */
+    {
+        handle->debug_print("ina219: read bus voltage register failed.\n");     /* read bus voltage register failed */
+       
+        return 1;                                                               /* return error */
+    }
+    if ((raw & (1 << 0)) != 0)
+    {
+        handle->debug_print("ina219: math overflow.\n");                        /* math overflow */
+       
+        return 4;                                                               /* return error */
+    }
+    *ready = (uint8_t)((raw >> 1) & 0x01);                                      /* get cnvr bit */
+    *bus = raw >> 3;                                                            /* right shift 3 */
+    
+    return 0;                                                                   /* success return 0 */
+}
+
+/**
+ * @brief      read current and power with one register read
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[in]  bus is the bus voltage from ina219_get_conversion_ready
+ * @param[out] *mV points to a bus voltage buffer
+ * @param[out] *mA points to a current buffer
+ * @param[out] *mW points to a power buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ * @note       current and power are computed from the shunt voltage and the
+ *             cached calibration instead of reading their registers
+ */
+uint8_t ina219_read_shunt_bus(ina219_handle_t *handle, uint16_t bus, float *mV, float *mA, float *mW)
+{
+    uint8_t res;
+    int32_t current;
+   
+    res = a_ina219_read_shunt_raw(handle, &current);                                  /* read shunt register */
+    if (res != 0)                                                                     /* check result */
+    {
+        return res;                                                                   /* return error */
+    }
+    *mV = (float)bus * 4.0f;                                                          /* set the bus voltage */
+    *mA = (float)((double)current * handle->current_lsb * 1000.0);                    /* set the current */
+    *mW = *mA * *mV / 1000.0f;                                                        /* set the power */
+    
+    return 0;                                                                         /* success return 0 */
+}
+
+/**
+ * @brief      read current and power in integer units with one register read
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[in]  bus is the bus voltage from ina219_get_conversion_ready
+ * @param[out] *mV points to a bus voltage buffer
+ * @param[out] *mA points to a current buffer
+ * @param[out] *mW points to a power buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ * @note       same as ina219_read_shunt_bus without any floating point math,
+ *             values are rounded to the nearest unit
+ */
+uint8_t ina219_read_shunt_bus_fixed(ina219_handle_t *handle, uint16_t bus, int32_t *mV, int32_t *mA, int32_t *mW)
+{
+    uint8_t res;
+    int32_t current;
+    int64_t na;
+   
+    res = a_ina219_read_shunt_raw(handle, &current);                                  /* read shunt register */
+    if (res != 0)                                                                     /* check result */
+    {
+        return res;                                                                   /* return error */
+    }
+    na = (int64_t)current * handle->current_lsb_na;                                   /* current in nA */
+    *mV = (int32_t)bus * 4;                                                           /* set the bus voltage */
+    *mA = (int32_t)((na + (na < 0 ? -500000 : 500000)) / 1000000);                    /* set the current */
+    *mW = (*mA * *mV) / 1000;                                                         /* set the power */
+    
+    return 0;                                                                         /* success return 0 */
+}
+
 /**
  * @brief      get the calibration
  * @param[in]  *handle points to an ina219 handle structure
@@ -937,6 +1114,7 @@ uint8_t ina219_calculate_calibration(ina219_handle_t *handle, uint16_t *calibrat
     else
     {
         handle->current_lsb = v / handle->r / pow(2.0, 15.0);                  /* current lsb */
+        handle->current_lsb_na = (uint32_t)(handle->current_lsb * 1e9 + 0.5);  /* current lsb in nA */
         *calibration = (uint16_t)(0.04096 / (v / pow(2.0, 15.0)));             /* set calibration */
         
         return 0;                                                              /* success return 0 */
@@ -974,6 +1152,7 @@ uint8_t ina219_set_calibration(ina219_handle_t *handle, uint16_t data)
        
         return 1;                                                                   /* return error */
     }
+    handle->calibration = data;                                                     /* save calibration */
     
     return 0;                                                                       /* success return 0 */
 }
@@ -1033,6 +1212,7 @@ uint8_t ina219_init(ina219_handle_t *handle)
         return 3;                                                              /* return error */
     }
     
+    handle->conf_cached = 0;                                                   /* chip state unknown */
     if (handle->iic_init() != 0)                                               /* iic init */
     {
         handle->debug_print("ina219: iic init failed.\n");                     /* iic init failed */
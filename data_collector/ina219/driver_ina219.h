@@ -146,6 +146,10 @@ typedef struct ina219_handle_s
     void (*debug_print)(const char *const fmt, ...);                                    /**< point to a debug_print function address */
     double r;                                                                           /**< resistance */
     double current_lsb;                                                                 /**< current lsb */
+    uint32_t current_lsb_na;                                                            /**< current lsb in nA */
+    uint16_t calibration;                                                               /**< last written calibration */
+    uint16_t conf;                                                                      /**< cached config register */
+    uint8_t conf_cached;                                                                /**< cached config valid flag */
     uint8_t inited;                                                                     /**< inited flag */
 } ina219_handle_t;
 
@@ -381,6 +385,56 @@ uint8_t ina219_read_current(ina219_handle_t *handle, int16_t *raw, float *mA);
  */
 uint8_t ina219_read_power(ina219_handle_t *handle, uint16_t *raw, float *mW);
 
+/**
+ * @brief      get the conversion ready flag
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[out] *ready points to a flag buffer, 1 once a triggered conversion has completed
+ * @param[out] *bus points to a bus voltage buffer, in 4 mV steps
+ * @return     status code
+ *             - 0 success
+ *             - 1 get conversion ready failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ *             - 4 math overflow
+ * @note       the flag is cleared by reading the power register or writing the config register,
+ *             the flag shares the bus voltage register so the poll returns the voltage too
+ */
+uint8_t ina219_get_conversion_ready(ina219_handle_t *handle, uint8_t *ready, uint16_t *bus);
+
+/**
+ * @brief      read current and power with one register read
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[in]  bus is the bus voltage from ina219_get_conversion_ready
+ * @param[out] *mV points to a bus voltage buffer
+ * @param[out] *mA points to a current buffer
+ * @param[out] *mW points to a power buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ * @note       current and power are computed from the shunt voltage and the
+ *             cached calibration instead of reading their registers
+ */
+uint8_t ina219_read_shunt_bus(ina219_handle_t *handle, uint16_t bus, float *mV, float *mA, float *mW);
+
+/**
+ * @brief      read current and power in integer units with one register read
+ * @param[in]  *handle points to an ina219 handle structure
+ * @param[in]  bus is the bus voltage from ina219_get_conversion_ready
+ * @param[out] *mV points to a bus voltage buffer
+ * @param[out] *mA points to a current buffer
+ * @param[out] *mW points to a power buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ * @note       same as ina219_read_shunt_bus without any floating point math,
+ *             values are rounded to the nearest unit
+ */
+uint8_t ina219_read_shunt_bus_fixed(ina219_handle_t *handle, uint16_t bus, int32_t *mV, int32_t *mA, int32_t *mW);
+
 /**
  * @brief     soft reset the chip
  * @param[in] *handle points to an ina219 handle structure
@@ -118,8 +118,8 @@ uint8_t ina219_basic_init(ina219_handle_t *gs_handle, ina219_address_t addr_pin,
         return 1;
     }
     
-    /* set shunt bus voltage continuous */
-    res = ina219_set_mode(gs_handle, INA219_MODE_SHUNT_BUS_VOLTAGE_CONTINUOUS);
+    /* set mode, power down until a conversion is triggered */
+    res = ina219_set_mode(gs_handle, INA219_BASIC_DEFAULT_MODE);
     if (res != 0)
     {
         ina219_interface_debug_print("ina219: set mode failed.\n");
@@ -201,6 +201,114 @@ uint8_t ina219_basic_read(ina219_handle_t *gs_handle, float *mV, float *mA, floa
     return 0;
 }
 
+/**
+ * @brief      run one triggered conversion
+ * @param[in]  *gs_handle points to an ina219 handle structure
+ * @param[out] *bus points to a bus voltage buffer, read by the ready poll
+ * @return     status code
+ *             - 0 success
+ *             - 1 conversion failed
+ * @note       the chip is powered down again on failure
+ */
+static uint8_t a_ina219_basic_convert(ina219_handle_t *gs_handle, uint16_t *bus)
+{
+    uint8_t res;
+    uint8_t ready;
+    uint32_t waited;
+    
+    /* trigger shunt and bus conversion, waits the nominal conversion time */
+    res = ina219_set_mode(gs_handle, INA219_MODE_SHUNT_BUS_VOLTAGE_TRIGGERED);
+    if (res != 0)
+    {
+        return 1;
+    }
+    
+    /* poll conversion ready */
+    for (waited = 0; ; waited++)
+    {
+        res = ina219_get_conversion_ready(gs_handle, &ready, bus);
+        if (res != 0 || ready != 0 || waited >= INA219_BASIC_CONVERSION_TIMEOUT_MS)
+        {
+            break;
+        }
+        ina219_interface_delay_ms(1);
+    }
+    if (res != 0 || ready == 0)
+    {
+        ina219_interface_debug_print("ina219: conversion timeout.\n");
+        (void)ina219_set_mode(gs_handle, INA219_MODE_POWER_DOWN);
+        
+        return 1;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief      basic example triggered read
+ * @param[out] *mV points to a mV buffer
+ * @param[out] *mA points to a mA buffer
+ * @param[out] *mW points to a mW buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ * @note       starts a single shunt and bus conversion, polls the conversion
+ *             ready flag and powers the chip down again after reading
+ */
+uint8_t ina219_basic_read_triggered(ina219_handle_t *gs_handle, float *mV, float *mA, float *mW)
+{
+    uint8_t res;
+    uint16_t bus;
+    
+    if (a_ina219_basic_convert(gs_handle, &bus) != 0)
+    {
+        return 1;
+    }
+    
+    /* the poll read the bus voltage, read the shunt voltage, the next trigger clears the ready flag */
+    res = ina219_read_shunt_bus(gs_handle, bus, mV, mA, mW);
+    
+    /* power down until the next trigger */
+    if (ina219_set_mode(gs_handle, INA219_MODE_POWER_DOWN) != 0 || res != 0)
+    {
+        return 1;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief      basic example triggered read in integer units
+ * @param[out] *mV points to a mV buffer
+ * @param[out] *mA points to a mA buffer
+ * @param[out] *mW points to a mW buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ * @note       same as ina219_basic_read_triggered without floating point math
+ */
+uint8_t ina219_basic_read_triggered_fixed(ina219_handle_t *gs_handle, int32_t *mV, int32_t *mA, int32_t *mW)
+{
+    uint8_t res;
+    uint16_t bus;
+    
+    if (a_ina219_basic_convert(gs_handle, &bus) != 0)
+    {
+        return 1;
+    }
+    
+    /* the poll read the bus voltage, read the shunt voltage, the next trigger clears the ready flag */
+    res = ina219_read_shunt_bus_fixed(gs_handle, bus, mV, mA, mW);
+    
+    /* power down until the next trigger */
+    if (ina219_set_mode(gs_handle, INA219_MODE_POWER_DOWN) != 0 || res != 0)
+    {
+        return 1;
+    }
+    
+    return 0;
+}
+
 /**
  * @brief  basic example deinit
  * @return status code
@@ -57,6 +57,8 @@ extern "C"{
 #define INA219_BASIC_DEFAULT_BUS_VOLTAGE_ADC_MODE         INA219_ADC_MODE_12_BIT_1_SAMPLES         /**< set bus voltage adc mode 12 bit 1 sample */
 #define INA219_BASIC_DEFAULT_SHUNT_VOLTAGE_ADC_MODE       INA219_ADC_MODE_12_BIT_1_SAMPLES         /**< set shunt voltage adc mode 12 bit 1 sample */
 #define INA219_BASIC_DEFAULT_PGA                          INA219_PGA_320_MV                        /**< set pga 320 mV */
+#define INA219_BASIC_DEFAULT_MODE                         INA219_MODE_POWER_DOWN                   /**< power down until triggered */
+#define INA219_BASIC_CONVERSION_TIMEOUT_MS                80                                       /**< conversion ready poll timeout, one 128 sample conversion */
 
 /**
  * @brief     basic example init
@@ -69,6 +71,31 @@ extern "C"{
  */
 uint8_t ina219_basic_init(ina219_handle_t *gs_handle, ina219_address_t addr_pin, double r);
 
+/**
+ * @brief      basic example triggered read
+ * @param[out] *mV points to a mV buffer
+ * @param[out] *mA points to a mA buffer
+ * @param[out] *mW points to a mW buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ * @note       starts a single shunt and bus conversion, polls the conversion
+ *             ready flag and powers the chip down again after reading
+ */
+uint8_t ina219_basic_read_triggered(ina219_handle_t *gs_handle, float *mV, float *mA, float *mW);
+
+/**
+ * @brief      basic example triggered read in integer units
+ * @param[out] *mV points to a mV buffer
+ * @param[out] *mA points to a mA buffer
+ * @param[out] *mW points to a mW buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read failed
+ * @note       same as ina219_basic_read_triggered without floating point math
+ */
+uint8_t ina219_basic_read_triggered_fixed(ina219_handle_t *gs_handle, int32_t *mV, int32_t *mA, int32_t *mW);
+
 /**
  * @brief  basic example deinit
  * @return status code
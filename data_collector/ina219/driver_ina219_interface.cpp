@@ -21,8 +21,8 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  *
- * @file      driver_ina219_interface_template.c
- * @brief     driver ina219 interface template source file
+ * @file      driver_ina219_interface.cpp
+ * @brief     driver ina219 interface source file
  * @version   1.0.0
  * @author    Shifeng Li
  * @date      2021-06-13
@@ -35,37 +35,33 @@
  */
 
 #include "pico/stdlib.h"
-#include "hardware/i2c.h"
 
 #include "driver_ina219_interface.h"
+#include "i2c_bus.h"
+#include "Log.h"
 
-#define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
-#define BYTE_TO_BINARY(byte)  \
-((byte) & 0x80 ? '1' : '0'), \
-((byte) & 0x40 ? '1' : '0'), \
-((byte) & 0x20 ? '1' : '0'), \
-((byte) & 0x10 ? '1' : '0'), \
-((byte) & 0x08 ? '1' : '0'), \
-((byte) & 0x04 ? '1' : '0'), \
-((byte) & 0x02 ? '1' : '0'), \
-((byte) & 0x01 ? '1' : '0')
+static i2c_bus_t *gs_bus;        /**< shared iic bus */
 
+/**
+ * @brief     interface set the shared iic bus
+ * @param[in] *bus points to an initialized i2c bus
+ * @note      must be called before any ina219 is initialized
+ */
+void ina219_interface_set_bus(i2c_bus_t *bus)
+{
+    gs_bus = bus;
+}
 
 /**
  * @brief  interface iic bus init
  * @return status code
  *         - 0 success
  *         - 1 iic init failed
- * @note   none
+ * @note   the bus is owned by the application and shared with other devices
  */
 uint8_t ina219_interface_iic_init(void)
 {
-    i2c_init(i2c_default, 100 * 1000);
-    gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
-    gpio_pull_up(PICO_DEFAULT_I2C_SCL_PIN);
-    return 0;
+    return gs_bus == NULL ? 1 : 0;
 }
 
 /**
@@ -73,11 +69,10 @@ uint8_t ina219_interface_iic_init(void)
  * @return status code
  *         - 0 success
  *         - 1 iic deinit failed
- * @note   none
+ * @note   the shared bus stays up
  */
 uint8_t ina219_interface_iic_deinit(void)
 {
-    i2c_deinit(i2c_default);
     return 0;
 }
 
@@ -90,20 +85,21 @@ uint8_t ina219_interface_iic_deinit(void)
  * @return     status code
  *             - 0 success
  *             - 1 read failed
- * @note       none
+ * @note       register pointer write and read in one transaction, with a repeated start
  */
 uint8_t ina219_interface_iic_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len)
 {
-    // Send the register address (write phase)
-    if (i2c_write_blocking(i2c_default, addr, &reg, 1, true) != 1) {
-        printf("Failed to write I2C read register\n");
-        return 1; // Write failed
-    }
+    i2c_transaction_t transaction = {};
+    transaction.addr = addr;
+    transaction.tx = &reg;
+    transaction.tx_len = 1;
+    transaction.rx = buf;
+    transaction.rx_len = len;
+    transaction.timeout_us = INA219_INTERFACE_IIC_TIMEOUT_US;
 
-    // Read the data (read phase)
-    int res = i2c_read_blocking(i2c_default, addr, buf, len, false);
-    if (res != len) {
-        printf("Failed to read I2C read register. res: %d\n", res);
+    i2c_bus_result_t res = i2c_bus_transfer_blocking(gs_bus, &transaction);
+    if (res != I2C_BUS_RESULT_OK) {
+        LOG_ERROR("ina219 at {} read of reg {} failed: {}", addr, reg, static_cast<int>(res));
         return 1; // Read failed
     }
 
@@ -119,11 +115,16 @@ uint8_t ina219_interface_iic_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint1
  * @return    status code
  *            - 0 success
  *            - 1 write failed
- * @note      none
+ * @note      registers are 16 bits wide, longer writes are rejected
  */
 uint8_t ina219_interface_iic_write(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len)
 {
-    uint8_t data[len + 1];
+    uint8_t data[1 + 2];
+
+    if (len > sizeof(data) - 1) {
+        LOG_ERROR("ina219 at {} write of {} bytes to reg {} rejected", addr, len, reg);
+        return 1;
+    }
 
     // Combine the register address and data into one buffer
     data[0] = reg;            // First byte is the register address
@@ -131,9 +132,15 @@ uint8_t ina219_interface_iic_write(uint8_t addr, uint8_t reg, uint8_t *buf, uint
         data[i + 1] = buf[i]; // Copy the data bytes
     }
 
-    // Write the combined data to the I2C device
-    if (i2c_write_blocking(i2c_default, addr, data, len + 1, false) != (len + 1)) {
-        printf("I2C write failed\n");
+    i2c_transaction_t transaction = {};
+    transaction.addr = addr;
+    transaction.tx = data;
+    transaction.tx_len = static_cast<uint16_t>(len + 1);
+    transaction.timeout_us = INA219_INTERFACE_IIC_TIMEOUT_US;
+
+    i2c_bus_result_t res = i2c_bus_transfer_blocking(gs_bus, &transaction);
+    if (res != I2C_BUS_RESULT_OK) {
+        LOG_ERROR("ina219 at {} write of reg {} failed: {}", addr, reg, static_cast<int>(res));
         return 1; // Write failed
     }
 
@@ -153,9 +160,21 @@ void ina219_interface_delay_ms(uint32_t ms)
 /**
  * @brief     interface print format data
  * @param[in] fmt is the format data
- * @note      none
+ * @note      the driver only passes plain messages, they go to the debug log without the trailing newline
  */
 void ina219_interface_debug_print(const char *const fmt, ...)
 {
-    printf(fmt);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    char message[LOG_LINE_MAX];
+    size_t len = strcspn(fmt, "\n");
+
+    if (len >= sizeof(message)) {
+        len = sizeof(message) - 1;
+    }
+    memcpy(message, fmt, len);
+    message[len] = '\0';
+    LOG_DEBUG("{}", message);
+#else
+    (void)fmt;
+#endif
 }
@@ -43,6 +43,8 @@
 extern "C"{
 #endif
 
+struct i2c_bus_t;    /* defined in i2c_bus.h, host tests link their own interface */
+
 /**
  * @defgroup ina219_interface_driver ina219 interface driver function
  * @brief    ina219 interface driver modules
@@ -50,6 +52,18 @@ extern "C"{
  * @{
  */
 
+/**
+ * @brief interface iic transaction timeout
+ */
+#define INA219_INTERFACE_IIC_TIMEOUT_US 5000        /**< 5 ms */
+
+/**
+ * @brief     interface set the shared iic bus
+ * @param[in] *bus points to an initialized i2c bus
+ * @note      must be called before any ina219 is initialized
+ */
+void ina219_interface_set_bus(struct i2c_bus_t *bus);
+
 /**
  * @brief  interface iic bus init
  * @return status code
@@ -30,6 +30,7 @@
 
 #include "jems.h"
 
+#include <assert.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -117,6 +118,26 @@ jems_t *jems_integer(jems_t *jems, int64_t value) {
   return emit_string(jems, buf);
 }
 
+jems_t *jems_fixed(jems_t *jems, int64_t value, uint8_t decimals) {
+  char buf[33]; // 20 digits, 1 sign, 1 point, 10 digits of a uint32_t, 1 null
+  uint64_t scale = 1;
+  uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+  assert(decimals <= JEMS_FIXED_MAX_DECIMALS);
+  if (decimals > JEMS_FIXED_MAX_DECIMALS) {
+    decimals = JEMS_FIXED_MAX_DECIMALS; // wrong scale without asserts, but no overflow
+  }
+  if (decimals == 0) {
+    return jems_integer(jems, value);
+  }
+  for (uint8_t i = 0; i < decimals; i++) {
+    scale *= 10;
+  }
+  snprintf(buf, sizeof(buf), "%s%" PRIu64 ".%0*" PRIu32, value < 0 ? "-" : "",
+           magnitude / scale, (int)decimals, (uint32_t)(magnitude % scale));
+  commify(jems);
+  return emit_string(jems, buf);
+}
+
 jems_t *jems_string(jems_t *jems, const char *string) {
   commify(jems);
   emit_char(jems, '"');
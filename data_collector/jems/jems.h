@@ -48,6 +48,8 @@ extern "C" {
 // *****************************************************************************
 // Public types and definitions
 
+#define JEMS_FIXED_MAX_DECIMALS 9 // 10^9 keeps the scale and the output short
+
 typedef struct {
   size_t item_count;       // # of items emitted at this level
   bool is_object;     // if true, use ':' separator
@@ -130,6 +132,13 @@ jems_t *jems_number(jems_t *jems, double value);
  */
 jems_t *jems_integer(jems_t *jems, int64_t value);
 
+/**
+ * @brief Emit a scaled integer as a decimal number, e.g. 2345 with 2 decimals
+ * as 23.45, using integer arithmetic only. decimals must not exceed
+ * JEMS_FIXED_MAX_DECIMALS.
+ */
+jems_t *jems_fixed(jems_t *jems, int64_t value, uint8_t decimals);
+
 /**
  * @brief Emit a null-terminated string in JSON format, quoting as needed.
  */
@@ -1,5 +1,3 @@
-#include <iostream>
-
 #include "pico/stdlib.h"
 #include "pico/stdio.h"
 #include "hardware/uart.h"
@@ -7,16 +5,30 @@
 #include "hardware/i2c.h"
 #include <hardware/rtc.h>
 #include <hardware/structs/clocks.h>
+#include <hardware/structs/xip_ctrl.h>
 #include <pico/runtime_init.h>
 #include <pico/sleep.h>
 #include <pico/util/datetime.h>
 
 #include "driver_ina219_basic.h"
+#include "ClockGovernor.h"
 #include "dht.h"
+#include "EnergyMeter.h"
+#include "EventFlags.h"
+#include "FixedString.h"
+#include "i2c_bus.h"
 #include "jems.h"
+#include "Log.h"
+#include "MemoryMonitor.h"
+#include "ModemCore.h"
 #include "MQTT.h"
 #include "GPS.h"
+#include "PowerRail.h"
+#include "Profiler.h"
+#include "RunningStats.h"
 #include "Sensors.h"
+#include "DutyCycle.h"
+#include "TimeKeeper.h"
 
 // Hardware IO pins
 #define GPIO_NBIOT_RST 2        // NB-IoT module reset
@@ -37,6 +49,12 @@
 #define UART_GPS_TX_PIN 8
 #define UART_GPS_RX_PIN 9
 
+// Shared I2C bus for the power monitors
+#define I2C_BUS_ID i2c_default
+#define I2C_BUS_BAUD_RATE I2C_BUS_FAST_MODE
+#define I2C_BUS_SDA_PIN PICO_DEFAULT_I2C_SDA_PIN
+#define I2C_BUS_SCL_PIN PICO_DEFAULT_I2C_SCL_PIN
+
 // Generic UART config
 #define DATA_BITS 8
 #define STOP_BITS 1
@@ -44,227 +62,569 @@
 
 // Jems JSON library config
 #define JSON_MAX_LEVEL 10
+#define JSON_REPORT_SIZE MQTT_MAX_PAYLOAD   // One sensor report, it must fit in one message
+#define JSON_BATCH_REPORTS 4    // Reports sent in one modem session at most
+#define JSON_PROFILE_SIZE 320   // Room left in a report for the profile totals
+#define JSON_GPS_SIZE 256
+
+// Profile totals are logged and added to every Nth report while there is
+// spare energy, 0 disables them
+#define PROFILE_REPORT_INTERVAL 24
 
 // Enable/disable parts of the firmware
 #define MODULE_NBIOT_ENABLE true
 #define MODULE_GPS_ENABLE true
 #define MODULE_ENERGY_ENABLE true
+#define MODEM_ON_CORE1 true     // Run the NB-IoT UART and AT engine on core 1
 
-// Measurement intervals
-#define POWER_AVG_COUNT 1
-#define POWER_AVG_READING_COUNT 60
-#define WAKE_INTERVAL_MS 10000
+// Longest time to stay awake, the intervals are set by the power profiles in DutyCycle.cpp
 #define WAKE_TIMEOUT_MS 120000
-#define REPORT_INTERVAL_MS (1 * 60 * 1000)
-#define GPS_INTERVAL 8640     // 1h: 360; 24h: 8640
+#define WAKE_WORK_MAX_MS 15000  // Sampling and reporting after the wait, the DHT retries take longest
+#define SENSOR_RAIL_EARLY_MAX_MS 15000  // Longest sleep the sensor rail is raised ahead of a report
+#define LED_BLINK_MS 20         // The LED blinks once per wake, keeping it on costs awake current
 
 using namespace std;
 
-int power_avg_count = 0;
+// Statistics of one power channel over a report interval
+typedef struct {
+    RunningStats<measurement_t> voltage;
+    RunningStats<measurement_t> current;
+} power_stats_t;
+
 int power_reading_count = 0;
-power_t power_avg[POWER_AVG_COUNT] = {0};
+power_stats_t solar_stats;
+power_stats_t battery_stats;
 
-string json_sensors;
-string json_gps;
+FixedString<JSON_REPORT_SIZE> json_sensors;
+FixedString<MQTT_MAX_PAYLOAD + 1> json_batch;     // The opening bracket is skipped for one report
+FixedString<JSON_GPS_SIZE> json_gps;
+int batch_count = 0;
+bool report_held = false;       // json_sensors did not fit the last batch and starts the next one
+int report_count = 0;
 
 static jems_level_t jems_levels[JSON_MAX_LEVEL];
 static jems_t jems;
 
 int gps_interval = 2;
+static bool gps_first_fix = true;
+
+// Set when a module is done and the device may sleep, or the wake alarm fired
+#define EVENT_MQTT_READY (1u << 0)
+#define EVENT_GPS_READY (1u << 1)
+#define EVENT_WAKE_ALARM (1u << 2)
+#define EVENT_GPS_FIX (1u << 3)     // Set from the GPS interrupt, the fix is sent from the main loop
 
-static bool awake;
-static volatile bool mqtt_ready = false;
-static volatile bool gps_ready = true;
+static EventFlags events(EVENT_GPS_READY);
 
 bool do_measurements();
 void sleep();
+void wake();
 void on_nbiot_rx();
 void on_gps_rx();
+void on_gps_fix();
 void send_gps_data();
 
-// Initialize MQTT, GPS, and Sensors modules
+// Initialize time keeping, MQTT, GPS, and Sensors modules
 // MQTT and GPS have callbacks for when they are ready to sleep
-MQTT mqtt(UART_NBIOT_ID, [](bool ready) {
-    cout << "mqtt ready: " << ready << endl;
-    mqtt_ready = ready;
+TimeKeeper timekeeper;
+MQTT mqtt(UART_NBIOT_ID, &timekeeper, [](bool ready) {
+    LOG_DEBUG("mqtt ready: {}", ready);
+    if (ready) {
+        events.set(EVENT_MQTT_READY);
+    } else {
+        events.clear(EVENT_MQTT_READY);
+    }
 });
-GPS gps(UART_GPS_ID, GPIO_POWER_GPS, [] {
-    cout << "gps ready: 1" << endl;
-    gps_ready = true;
+GPS gps(UART_GPS_ID, &timekeeper, GPIO_POWER_GPS, [] {
+    LOG_DEBUG("gps ready: 1");
+    events.set(EVENT_GPS_READY);
 });
-Sensors sensors(GPIO_POWER_SENSORS);
+i2c_bus_t i2c_bus;
+PowerRail sensor_power(GPIO_POWER_SENSORS);
+Sensors sensors(&sensor_power, GPIO_DHT1, GPIO_DHT2);
+EnergyMeter energy;
+#if MODEM_ON_CORE1
+ModemCore modem_core(&mqtt, UART_NBIOT_ID);
+#endif
+DutyCycle duty_cycle;
+MemoryMonitor memory;
+Profiler profiler;
+ClockGovernor clock_governor(&i2c_bus);
+
+
+// Time spent awake and asleep since boot. The energy meter only samples while
+// awake, so the sleep charge is worked out on the host from these times and
+// the measured currents, see tools/sleep_budget.py.
+typedef struct {
+    uint64_t awake_us;
+    uint64_t asleep_us;
+} sleep_stats_t;
+
+static sleep_stats_t sleep_stats;
+
+// XIP cache use of the last wake cycle, from one sleep to the next. It
+// includes the cold start of the wake path. The counters saturate, so they
+// are cleared before every sleep.
+typedef struct {
+    uint32_t hits;
+    uint32_t accesses;
+} xip_stats_t;
+
+static xip_stats_t xip_stats;
+static absolute_time_t wake_time = nil_time;
+
+static void set_uart_rx_irq(uart_inst_t *uart, irq_handler_t handler, bool enabled) {
+    int irq = uart == uart0 ? UART0_IRQ : UART1_IRQ;
+
+    if (enabled) {
+        irq_set_exclusive_handler(irq, handler);
+        irq_set_enabled(irq, true);
+        uart_set_irq_enables(uart, true, false);
+    } else {
+        irq_set_enabled(irq, false);
+        irq_clear(irq);
+        uart_set_irq_enables(uart, false, false);
+    }
+}
+
+// UART RX interrupts are masked while asleep to prevent unwanted wakes
+static void suspend_uart_irqs() {
+#if MODEM_ON_CORE1
+    modem_core.suspend();
+#else
+    set_uart_rx_irq(UART_NBIOT_ID, on_nbiot_rx, false);
+#endif
+    set_uart_rx_irq(UART_GPS_ID, on_gps_rx, false);
+}
+
+static void resume_uart_irqs() {
+#if MODEM_ON_CORE1
+    modem_core.resume();
+#else
+    set_uart_rx_irq(UART_NBIOT_ID, on_nbiot_rx, true);
+#endif
+    set_uart_rx_irq(UART_GPS_ID, on_gps_rx, true);
+}
+
+static void sample_xip_counters() {
+    xip_stats = {xip_ctrl_hw->ctr_hit, xip_ctrl_hw->ctr_acc};
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+    LOG_DEBUG("xip hit {}/{}", xip_stats.hits, xip_stats.accesses);
+}
 
 // Handle waking from sleep mode
-static void alarm_sleep_callback(uint alarm_id) {
-    printf("alarm woke us up\n");
-    uart_default_tx_wait_blocking();
-    awake = true;
+static void __not_in_flash_func(alarm_sleep_callback)(uint alarm_id) {
+    LOG_DEBUG("alarm woke us up");
+    events.set(EVENT_WAKE_ALARM);
     hardware_alarm_set_callback(alarm_id, NULL);
     hardware_alarm_unclaim(alarm_id);
 }
 
+// Light sleep: the crystal and the timer keep running
+static uint64_t __not_in_flash_func(sleep_light)(uint32_t ms) {
+    absolute_time_t start = get_absolute_time();
+
+    sleep_run_from_xosc();
+    if (sleep_goto_sleep_for(ms, &alarm_sleep_callback)) {
+        // The alarm is armed. Any other interrupt also ends the sleep, so
+        // keep waiting until the alarm itself has fired.
+        while (!events.all(EVENT_WAKE_ALARM)) {
+            __wfe();
+        }
+    }
+    sleep_power_up();
+
+    return absolute_time_diff_us(start, get_absolute_time());
+}
+
+static int64_t led_off_callback(alarm_id_t id, void *user_data) {
+    gpio_put(PICO_DEFAULT_LED_PIN, false);
+    return 0;
+}
+
 // Wait for all modules to be ready and go to sleep
 void sleep() {
     absolute_time_t sleep_start_time = get_absolute_time();
-    cout << "waiting for mqtt & gps... " << sleep_start_time << endl;
-    while (true) {
-        gpio_put(PICO_DEFAULT_LED_PIN, true);
-        sleep_ms(100);
-        gpio_put(PICO_DEFAULT_LED_PIN, false);
-        sleep_ms(100);
-
-        if (mqtt_ready && gps_ready) {
-            cout << "mqtt & gps ready" << endl;
-            break;
+    absolute_time_t deadline = delayed_by_ms(sleep_start_time, WAKE_TIMEOUT_MS);
+    LOG_INFO("waiting for mqtt & gps... {}", to_us_since_boot(sleep_start_time));
+
+    // The LED blinks as the wait starts. The core sleeps in WFE until a module
+    // signals it is done, and is back here within microseconds of the last one.
+    gpio_put(PICO_DEFAULT_LED_PIN, true);
+    alarm_id_t led_alarm = add_alarm_in_ms(LED_BLINK_MS, led_off_callback, nullptr, true);
+    clock_governor.set_level(CLOCK_IO);
+    while (!events.all(EVENT_MQTT_READY | EVENT_GPS_READY)) {
+        // The fix is encoded at full speed, then the wait goes on at the low clock
+        if (events.all(EVENT_GPS_FIX)) {
+            events.clear(EVENT_GPS_FIX);
+            clock_governor.set_level(CLOCK_FULL);
+            send_gps_data();
+            clock_governor.set_level(CLOCK_IO);
         }
 
-        // Stop waiting after WAKE_TIMEOUT_MS has passed
-        absolute_time_t now = get_absolute_time();
+        // Logging only buffers, the output is written while we wait anyway
+        log_flush();
 
-        if (sleep_start_time + (WAKE_TIMEOUT_MS * 1000) < now) {
-            cout << "mqtt & gps timeout" << endl;
-            mqtt_ready = true;
-            gps_ready = true;
-            break;
+        // Stop waiting after WAKE_TIMEOUT_MS has passed
+        if (!events.wait(deadline)) {
+            LOG_WARN("mqtt & gps timeout");
+            events.set(EVENT_MQTT_READY | EVENT_GPS_READY);
         }
-
-        tight_loop_contents();
     }
-    cout << "sleeping" << endl;
+    if (led_alarm > 0) {
+        cancel_alarm(led_alarm);
+    }
+    gpio_put(PICO_DEFAULT_LED_PIN, false);
+    LOG_INFO("mqtt & gps ready");
+
+    LOG_INFO("sleeping");
+    log_flush();
 
     // Turn off GPS
     gps.stop();
 
-    // Disable UART RX interrupts to prevent unwanted wake
-    int UART_NBIOT_IRQ = UART_NBIOT_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    irq_set_enabled(UART_NBIOT_IRQ, false);
-    irq_clear(UART_NBIOT_IRQ);
-    uart_set_irq_enables(UART_NBIOT_ID, false, false);
-
-    int UART_GPS_IRQ = UART_GPS_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    irq_set_enabled(UART_GPS_IRQ, false);
-    irq_clear(UART_GPS_IRQ);
-    uart_set_irq_enables(UART_GPS_ID, false, false);
-
-    // Run from external oscillator
-    sleep_run_from_xosc();
-    awake = false;
-
-    // Put CPU to sleep
+    suspend_uart_irqs();
+    events.clear(EVENT_WAKE_ALARM);
     uart_default_tx_wait_blocking();
-    if (sleep_goto_sleep_for(WAKE_INTERVAL_MS, &alarm_sleep_callback)) {
-        while (!awake) {
-            printf("Should be sleeping\n");
-        }
+
+    if (!is_nil_time(wake_time)) {
+        sleep_stats.awake_us += absolute_time_diff_us(wake_time, get_absolute_time());
     }
+    sample_xip_counters();
 
-    // Restore clocks after wake
-    sleep_power_up();
+    // Clocks are restored before returning
+    sleep_stats.asleep_us += sleep_light(duty_cycle.get_profile().wake_interval_ms);
+    clock_governor.on_wake();
+    wake_time = get_absolute_time();
 
-    // Enable UART RX interrupts
-    UART_NBIOT_IRQ = UART_NBIOT_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    irq_set_exclusive_handler(UART_NBIOT_IRQ, on_nbiot_rx);
-    irq_set_enabled(UART_NBIOT_IRQ, true);
-    uart_set_irq_enables(UART_NBIOT_ID, true, false);
-
-    UART_GPS_IRQ = UART_GPS_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    irq_set_exclusive_handler(UART_GPS_IRQ, on_gps_rx);
-    irq_set_enabled(UART_GPS_IRQ, true);
-    uart_set_irq_enables(UART_GPS_ID, true, false);
-
-    if (!--gps_interval) {
-        gps_ready = false;
-        gps_interval = GPS_INTERVAL;
-        gps.get_position_once(send_gps_data);
+    resume_uart_irqs();
+}
+
+// Start the GPS and the measurements of one wake
+void wake() {
+    // The first fix after boot is not shifted toward a charging window
+    const power_profile_t &profile = duty_cycle.get_profile();
+    gps_interval--;
+    bool gps_due = gps_first_fix ? profile.gps_interval > 0 && gps_interval <= 0 : duty_cycle.gps_fix_due(gps_interval);
+    if (gps_due) {
+        events.clear(EVENT_GPS_READY | EVENT_GPS_FIX);
+        gps_first_fix = false;
+        gps_interval = profile.gps_interval;
+        gps.get_position_once(on_gps_fix);
     }
 
     do_measurements();
+}
 
-    // Start next sleep cycle
-    sleep();
+// The payload is sent from core 1 in the dual-core mode
+static void modem_publish(const char *data) {
+#if MODEM_ON_CORE1
+    modem_core.publish(data);
+#else
+    mqtt.publish(data);
+#endif
 }
 
 // UART RX handler
-void on_nbiot_rx() {
+void __not_in_flash_func(on_nbiot_rx)() {
     mqtt.on_rx();
 }
 
 // UART RX handler
-void on_gps_rx() {
+void __not_in_flash_func(on_gps_rx)() {
     gps.on_rx();
 }
 
+static const char *const time_source_names[] = {"none", "modem", "gps"};
+
 // JEMS JSON helper
+template<size_t N>
 static void write_char(char ch, uintptr_t arg) {
-    *reinterpret_cast<string *>(arg) += ch;
+    reinterpret_cast<FixedString<N> *>(arg)->append(ch);
+}
+
+// Scaled integers are written with integer formatting only, see measurement_t
+static void write_measurement(measurement_t value, uint8_t decimals) {
+#ifdef FIXED_POINT
+    jems_fixed(&jems, value, decimals);
+#else
+    jems_number(&jems, value);
+#endif
+}
+
+// DHT reading with its error counters, stale values are sent as null
+static void write_environment(const environment_data_t &env, const dht_stats_t &stats) {
+    jems_object_open(&jems);
+    jems_string(&jems, "t");
+    if (env.valid) {
+        write_measurement(env.temperature, TEMPERATURE_DECIMALS);
+    } else {
+        jems_null(&jems);
+    }
+    jems_string(&jems, "rh");
+    if (env.valid) {
+        write_measurement(env.humidity, HUMIDITY_DECIMALS);
+    } else {
+        jems_null(&jems);
+    }
+    jems_string(&jems, "to");
+    jems_integer(&jems, stats.timeouts);
+    jems_string(&jems, "cs");
+    jems_integer(&jems, stats.checksum_errors);
+    jems_string(&jems, "rt");
+    jems_integer(&jems, stats.retries);
+    jems_string(&jems, "fail");
+    jems_integer(&jems, stats.failures);
+    jems_object_close(&jems);
+}
+
+// Interval mean under the plain name, extremes and spread as name_min,
+// name_max and name_sd, which catch short peaks such as modem TX bursts
+static void write_power_stats(const char *name, const RunningStats<measurement_t> &stats) {
+    FixedString<16> key;
+
+    jems_string(&jems, name);
+    jems_integer(&jems, static_cast<int>(stats.get_mean()));
+    key.append(name);
+    key.append("_min");
+    jems_string(&jems, key.c_str());
+    jems_integer(&jems, static_cast<int>(stats.get_min()));
+    key.clear();
+    key.append(name);
+    key.append("_max");
+    jems_string(&jems, key.c_str());
+    jems_integer(&jems, static_cast<int>(stats.get_max()));
+    key.clear();
+    key.append(name);
+    key.append("_sd");
+    jems_string(&jems, key.c_str());
+    write_measurement(stats.get_stddev(), 0);
+}
+
+// Per region: calls, us, XIP hits and accesses, the bus events named in "ev",
+// saturated calls
+static void write_profile() {
+    jems_string(&jems, "prof");
+    jems_object_open(&jems);
+    jems_string(&jems, "ev");
+    jems_array_open(&jems);
+    for (int i = 0; i < PROFILER_BUS_COUNTERS; i++) {
+        jems_string(&jems, Profiler::bus_event_name(i));
+    }
+    jems_array_close(&jems);
+
+    for (int i = 0; i < PROFILE_REGION_COUNT; i++) {
+        auto region = static_cast<profile_region_t>(i);
+        const profile_totals_t &t = profiler.get_totals(region);
+
+        jems_string(&jems, Profiler::region_name(region));
+        jems_array_open(&jems);
+        jems_integer(&jems, t.calls);
+        jems_integer(&jems, t.us);
+        jems_integer(&jems, t.xip_hits);
+        jems_integer(&jems, t.xip_accesses);
+        for (uint64_t count : t.bus) {
+            jems_integer(&jems, count);
+        }
+        jems_integer(&jems, t.saturated);
+        jems_array_close(&jems);
+    }
+    jems_object_close(&jems);
+}
+
+// Send JSON via MQTT, the batch buffer stays untouched until the next report
+static void publish_batch() {
+    const char *payload = json_batch.c_str() + 1;
+    if (batch_count > 1) {
+        json_batch.append(']');
+        payload = json_batch.c_str();
+    }
+    batch_count = 0;
+
+    modem_publish(payload);
 }
 
 void send_data() {
     // Read power values
     uint8_t charger_chg = !gpio_get(GPIO_CHG);
     uint8_t charger_pgood = !gpio_get(GPIO_PGOOD);
-    power_t *pavg = &power_avg[0];
 
     // Read sensors
+    profiler.begin(PROFILE_ENVIRONMENT_READ);
     sensors.read_environment();
+    profiler.end();
+
+    // A report that did not fit behind the last batch starts this one, the
+    // last publish has finished by now
+    if (report_held) {
+        json_batch.clear();
+        json_batch.append('[');
+        json_batch.append(json_sensors);
+        batch_count = 1;
+        report_held = false;
+    }
+
+    report_count++;
+    bool with_profile = PROFILE_REPORT_INTERVAL > 0 && report_count % PROFILE_REPORT_INTERVAL == 0 &&
+                        duty_cycle.has_spare_energy();
 
     // Construct a JSON object
+    profiler.begin(PROFILE_ENCODE);
     json_sensors.clear();
-    jems_init(&jems, jems_levels, JSON_MAX_LEVEL, write_char, reinterpret_cast<uintptr_t>(&json_sensors));
+    jems_init(&jems, jems_levels, JSON_MAX_LEVEL, write_char<JSON_REPORT_SIZE>, reinterpret_cast<uintptr_t>(&json_sensors));
 
     jems_object_open(&jems);            // {
+
+    // Reports may be held back for a batch, so each carries its own time.
+    // "ts_src" tells whether the clock has been set from the modem or GPS yet.
+    char timestamp[32];
+    timekeeper.format_timestamp(timestamp, sizeof(timestamp));
+    jems_string(&jems, "ts");
+    jems_string(&jems, timestamp);
+    jems_string(&jems, "ts_src");
+    jems_string(&jems, time_source_names[timekeeper.get_source()]);
+
     jems_string(&jems, "dht22");   //   "dht22"
     jems_array_open(&jems);             //     [
 
-    jems_object_open(&jems);
-    jems_string(&jems, "t");
-    jems_number(&jems, sensors.sensor_data.environment.box.temperature);
-    jems_string(&jems, "rh");
-    jems_number(&jems, sensors.sensor_data.environment.box.humidity);
-    jems_object_close(&jems);
-
-    jems_object_open(&jems);
-    jems_string(&jems, "t");
-    jems_number(&jems, sensors.sensor_data.environment.outside.temperature);
-    jems_string(&jems, "rh");
-    jems_number(&jems, sensors.sensor_data.environment.outside.humidity);
-    jems_object_close(&jems);
+    write_environment(sensors.sensor_data.environment.box, sensors.get_dht_stats(0));
+    write_environment(sensors.sensor_data.environment.outside, sensors.get_dht_stats(1));
 
     jems_array_close(&jems);            //      ],
 
     jems_string(&jems, "power");   //   "power"
     jems_object_open(&jems);             //     {
-    jems_string(&jems, "Vsol");
-    jems_integer(&jems, static_cast<int>(pavg->solar.voltage));
-    jems_string(&jems, "Isol");
-    jems_integer(&jems, static_cast<int>(pavg->solar.current));
-    jems_string(&jems, "Vbat");
-    jems_integer(&jems, static_cast<int>(pavg->battery.voltage));
-    jems_string(&jems, "Ibat");
-    jems_integer(&jems, static_cast<int>(pavg->battery.current));
+    write_power_stats("Vsol", solar_stats.voltage);
+    write_power_stats("Isol", solar_stats.current);
+    write_power_stats("Vbat", battery_stats.voltage);
+    write_power_stats("Ibat", battery_stats.current);
     jems_string(&jems, "is_charging");
     jems_bool(&jems, charger_chg);
     jems_string(&jems, "pgood");
     jems_bool(&jems, charger_pgood);
+    jems_string(&jems, "profile");
+    jems_string(&jems, duty_cycle.get_profile().name);
     jems_object_close(&jems);               //    }
 
+    // Totals since boot, in mWh and mAh
+    const energy_totals_t &totals = energy.get_totals();
+    jems_string(&jems, "energy");
+    jems_object_open(&jems);
+    jems_string(&jems, "Esol");
+    jems_number(&jems, totals.solar_mwh);
+    jems_string(&jems, "Ebat_in");
+    jems_number(&jems, totals.battery_in_mwh);
+    jems_string(&jems, "Ebat_out");
+    jems_number(&jems, totals.battery_out_mwh);
+    jems_string(&jems, "Qbat_in");
+    jems_number(&jems, totals.battery_in_mah);
+    jems_string(&jems, "Qbat_out");
+    jems_number(&jems, totals.battery_out_mah);
+    jems_string(&jems, "soc");
+    if (energy.has_soc()) {
+        jems_number(&jems, energy.get_soc_percent());
+    } else {
+        jems_null(&jems);
+    }
+    jems_string(&jems, "gaps");
+    jems_integer(&jems, totals.gaps);
+    jems_object_close(&jems);
+
+    // Peak stack use and heap claimed since boot, in bytes
+    const memory_stats_t &mem = memory.get_stats();
+    jems_string(&jems, "mem");
+    jems_object_open(&jems);
+    jems_string(&jems, "stack0");
+    jems_integer(&jems, mem.core0.peak);
+    jems_string(&jems, "stack1");
+    jems_integer(&jems, mem.core1.peak);
+    jems_string(&jems, "heap");
+    jems_integer(&jems, mem.heap_used);
+    jems_string(&jems, "log_drop");
+    jems_integer(&jems, log_dropped());
+    jems_object_close(&jems);
+
+    // Time in each power state since boot
+    jems_string(&jems, "sleep");
+    jems_object_open(&jems);
+    jems_string(&jems, "awake_ms");
+    jems_integer(&jems, sleep_stats.awake_us / 1000);
+    jems_string(&jems, "asleep_ms");
+    jems_integer(&jems, sleep_stats.asleep_us / 1000);
+    jems_object_close(&jems);
+
+    // XIP cache hits and accesses of the previous wake cycle
+    jems_string(&jems, "xip");
+    jems_object_open(&jems);
+    jems_string(&jems, "hit");
+    jems_integer(&jems, xip_stats.hits);
+    jems_string(&jems, "acc");
+    jems_integer(&jems, xip_stats.accesses);
+    jems_object_close(&jems);
+
+    // Skipped when the report would no longer fit one message, the totals are still logged
+    if (with_profile && json_sensors.size() + JSON_PROFILE_SIZE < JSON_REPORT_SIZE) {
+        write_profile();
+    }
+
     jems_object_close(&jems);     // }
+    profiler.end();
+
+    if (with_profile) {
+        profiler.dump();
+    }
 
-    // Send JSON object via MQTT
-    mqtt.publish(json_sensors.data());
+    if (json_sensors.is_truncated()) {
+        LOG_ERROR("report does not fit in {} bytes", JSON_REPORT_SIZE);
+        events.set(EVENT_MQTT_READY);
+        return;
+    }
+
+    // Reports are collected into a JSON array and sent in one modem session,
+    // at once while the charger has spare solar power. The array is opened
+    // up front and skipped when it holds a single report. A report that would
+    // take the array past MQTT_MAX_PAYLOAD is held back for the next batch.
+    if (batch_count > 0 && json_batch.size() + json_sensors.size() + 2 > MQTT_MAX_PAYLOAD) {
+        report_held = true;
+        publish_batch();
+        return;
+    }
+
+    if (batch_count == 0) {
+        json_batch.clear();
+        json_batch.append('[');
+    } else {
+        json_batch.append(',');
+    }
+    json_batch.append(json_sensors);
+    batch_count++;
+
+    if (!duty_cycle.send_batch_now(batch_count) && batch_count < JSON_BATCH_REPORTS) {
+        events.set(EVENT_MQTT_READY);
+        return;
+    }
+
+    publish_batch();
+}
+
+// Called from the GPS UART interrupt. Publishing from there could interleave
+// with a publish of the main loop, so the fix is only flagged here.
+void on_gps_fix() {
+    events.set(EVENT_GPS_FIX);
 }
 
 void send_gps_data() {
     if (!gps.gps_data_ready) {
-        gps_ready = true;
+        events.set(EVENT_GPS_READY);
         return;
     }
 
-    mqtt_ready = false;
+    events.clear(EVENT_MQTT_READY);
 
     // Construct a JSON object
     json_gps.clear();
-    jems_init(&jems, jems_levels, JSON_MAX_LEVEL, write_char, reinterpret_cast<uintptr_t>(&json_gps));
+    jems_init(&jems, jems_levels, JSON_MAX_LEVEL, write_char<JSON_GPS_SIZE>, reinterpret_cast<uintptr_t>(&json_gps));
 
     jems_object_open(&jems);          // {
 
@@ -274,61 +634,81 @@ void send_gps_data() {
     jems_object_close(&jems);          // }
 
     // Send JSON via MQTT
-    mqtt.publish(json_gps.data());
+    modem_publish(json_gps.c_str());
 
     gps.gps_data_ready = false;
-    gps_ready = true;
+    events.set(EVENT_GPS_READY);
+}
+
+// Switch the sampling, report and GPS intervals to the current power profile
+static void apply_power_profile() {
+    const power_profile_t &profile = duty_cycle.get_profile();
+    LOG_INFO("power profile: {}", profile.name);
+
+    sensors.set_power_sampling(profile.sampling);
+    energy.set_max_gap_ms(profile.wake_interval_ms + WAKE_TIMEOUT_MS + WAKE_WORK_MAX_MS);
+    if (profile.gps_interval > 0 && gps_interval > profile.gps_interval) {
+        gps_interval = profile.gps_interval;
+    }
 }
 
 bool do_measurements() {
+    profiler.begin(PROFILE_POWER_READ);
     sensors.read_power();
+    profiler.end();
 
-    power_t *pavg = &power_avg[power_avg_count];
+    const power_t &power = sensors.sensor_data.power;
+    bool charging = !gpio_get(GPIO_CHG);
+    bool power_good = !gpio_get(GPIO_PGOOD);
+    energy.add_sample(power.solar.power, power.battery.current, power.battery.power, charging, power_good);
 
-    pavg->battery.voltage += sensors.sensor_data.power.battery.voltage;
-    pavg->battery.current += sensors.sensor_data.power.battery.current;
-    pavg->solar.voltage += sensors.sensor_data.power.solar.voltage;
-    pavg->solar.current += sensors.sensor_data.power.solar.current;
+    if (duty_cycle.update(power.battery.voltage, power.battery.current, charging, power_good)) {
+        apply_power_profile();
+    }
+
+    solar_stats.voltage.add(power.solar.voltage);
+    solar_stats.current.add(power.solar.current);
+    battery_stats.voltage.add(power.battery.voltage);
+    battery_stats.current.add(power.battery.current);
 
     power_reading_count++;
 
-    if (power_reading_count >= POWER_AVG_READING_COUNT) {
-        pavg->battery.voltage /= (float)POWER_AVG_READING_COUNT;
-        pavg->battery.current /= (float)POWER_AVG_READING_COUNT;
-        pavg->solar.voltage /= (float)POWER_AVG_READING_COUNT;
-        pavg->solar.current /= (float)POWER_AVG_READING_COUNT;
+    // Each reading is already averaged by the INA219, see power_sampling_t
+    int reading_count = sensors.get_power_sampling().readings_per_report;
 
-        datetime_t t;
+    if (power_reading_count >= reading_count) {
         char datetime_buf[32];
-        rtc_get_datetime(&t);
-        sprintf(datetime_buf, "20%02d-%02d-%02dT%02d:%02d:%02d", t.year, t.month, t.day, t.hour, t.min, t.sec);
-        pavg->timestamp = datetime_buf;
+        timekeeper.format_timestamp(datetime_buf, sizeof(datetime_buf));
 
-        cout << pavg->timestamp << " - " << pavg->battery.current << endl;
+        LOG_INFO("{} - {}", datetime_buf, battery_stats.current.get_mean());
 
-        power_reading_count = 0;
-        power_avg_count++;
-    }
+        const memory_stats_t &mem = memory.update();
+        LOG_INFO("stack {}/{} core 1 {}/{} heap {}/{}", mem.core0.peak, mem.core0.size,
+                 mem.core1.peak, mem.core1.size, mem.heap_used, mem.heap_size);
 
-    if (power_avg_count >= POWER_AVG_COUNT) {
-        mqtt_ready = false;
+        events.clear(EVENT_MQTT_READY);
         send_data();
 
-        for (int i = 0; i < POWER_AVG_COUNT; i++) {
-            power_avg[i].battery.voltage = 0;
-            power_avg[i].battery.current = 0;
-            power_avg[i].solar.voltage = 0;
-            power_avg[i].solar.current = 0;
-        }
-
-        power_avg_count = 0;
+        solar_stats = {};
+        battery_stats = {};
         power_reading_count = 0;
     }
 
+    // Raise the sensor rail one wake ahead of the report, so the DHT
+    // stabilisation time passes while we sleep instead of blocking the report.
+    // Over a long sleep the rail current costs more than the wait it saves.
+    if (power_reading_count == reading_count - 1 &&
+        duty_cycle.get_profile().wake_interval_ms <= SENSOR_RAIL_EARLY_MAX_MS) {
+        sensors.power_up_environment();
+    }
+
     return true;
 }
 
 int main() {
+    memory.paint_stacks();
+    profiler.init();
+
     // Initialize microcontroller hardware
     stdio_init_all();
     rtc_init();
@@ -344,9 +724,7 @@ int main() {
     gpio_put(GPIO_POWER_GPS, false);
 
     // 3.3v power control pin as output and turn it off
-    gpio_init(GPIO_POWER_SENSORS);
-    gpio_set_dir(GPIO_POWER_SENSORS, GPIO_OUT);
-    gpio_put(GPIO_POWER_SENSORS, false);
+    sensor_power.init();
 
     // Charger "power good" signal pin as input with pull-up
     gpio_init(GPIO_PGOOD);
@@ -360,7 +738,7 @@ int main() {
 
     sleep_ms(1000);
 
-    cout << "Hello World" << endl;
+    LOG_INFO("Hello World");
     gpio_put(PICO_DEFAULT_LED_PIN, false);
 
 #if MODULE_NBIOT_ENABLE
@@ -378,10 +756,11 @@ int main() {
     uart_set_fifo_enabled(UART_NBIOT_ID, false);
 
     // UART RX interrupt handler
-    int UART_NBIOT_IRQ = UART_NBIOT_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    irq_set_exclusive_handler(UART_NBIOT_IRQ, on_nbiot_rx);
-    irq_set_enabled(UART_NBIOT_IRQ, true);
-    uart_set_irq_enables(UART_NBIOT_ID, true, false);
+#if MODEM_ON_CORE1
+    modem_core.start();
+#else
+    set_uart_rx_irq(UART_NBIOT_ID, on_nbiot_rx, true);
+#endif
 #endif
 
 #if MODULE_GPS_ENABLE
@@ -394,33 +773,38 @@ int main() {
     uart_set_fifo_enabled(UART_GPS_ID, false);
 
     // UART RX interrupt handler
-    int UART_GPS_IRQ = UART_GPS_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    irq_set_exclusive_handler(UART_GPS_IRQ, on_gps_rx);
-    irq_set_enabled(UART_GPS_IRQ, true);
-    uart_set_irq_enables(UART_GPS_ID, true, false);
+    set_uart_rx_irq(UART_GPS_ID, on_gps_rx, true);
 #endif
 
 #if MODULE_ENERGY_ENABLE
-    i2c_init(i2c_default, 100 * 1000);
-    gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
+    i2c_bus_init(&i2c_bus, I2C_BUS_ID, I2C_BUS_SDA_PIN, I2C_BUS_SCL_PIN, I2C_BUS_BAUD_RATE);
+    ina219_interface_set_bus(&i2c_bus);
 
     sensors.init();
+    apply_power_profile();
 #endif
 
+    // The UARTs keep their baud rates while clk_sys changes
+#if MODULE_NBIOT_ENABLE
+    clock_governor.add_uart(UART_NBIOT_ID, UART_NBIOT_BAUD_RATE);
+#endif
+#if MODULE_GPS_ENABLE
+    clock_governor.add_uart(UART_GPS_ID, UART_GPS_BAUD_RATE);
+#endif
+    clock_governor.init();
+
     // The NB-IoT module needs a reset signal after power on
-    std::cout << "Resetting NB-IoT board... ";
+    LOG_INFO("Resetting NB-IoT board...");
     gpio_put(GPIO_NBIOT_RST, false);
     sleep_ms(500);
     gpio_put(GPIO_NBIOT_RST, true);
-    std::cout << "done" << std::endl;
-
-    // Start the main sleep-wake cycle
-    sleep();
+    LOG_INFO("Resetting NB-IoT board done");
 
-    // Infinite loop to keep the main function busy
-    while (1)
-        tight_loop_contents();
+    // Main sleep-wake cycle
+    while (true) {
+        sleep();
+        wake();
+    }
 
     return 0;
 }
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "driver_ina219_basic.h"
+#include "jems.h"
+#include "FixedString.h"
+#include "Ina219Sim.h"
+#include "RunningStats.h"
+
+// The FIXED_POINT build must report the same values as the float build,
+// within one unit of the scaled integers
+
+#define SHUNT_OHM 0.1
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Noise-free signals, so both reads see the same conversion
+static void test_ina219() {
+    ina219_handle_t handle;
+
+    ina219_sim_reset(1);
+    ina219_sim_set_signal(INA219_ADDRESS_0, {0, 0, 0, 0});
+    check(ina219_basic_init(&handle, INA219_ADDRESS_0, SHUNT_OHM) == 0, "ina219 init");
+
+    for (double ma = -3000; ma <= 3000; ma += 37.3) {
+        for (double mv = 0; mv <= 20000; mv += 2999) {
+            float mv_f, ma_f, mw_f;
+            int32_t mv_i, ma_i, mw_i;
+
+            ina219_sim_set_signal(INA219_ADDRESS_0, {ma * SHUNT_OHM * 1000.0, mv, 0, 0});
+            check(ina219_basic_read_triggered(&handle, &mv_f, &ma_f, &mw_f) == 0, "ina219 float read");
+            check(ina219_basic_read_triggered_fixed(&handle, &mv_i, &ma_i, &mw_i) == 0, "ina219 fixed read");
+
+            check(mv_i == lroundf(mv_f), "bus voltage");
+            check(std::abs(ma_i - lroundf(ma_f)) <= 1, "current");
+            // Power is computed from the rounded current
+            check(std::abs(mw_i - lroundf(mw_f)) <= std::abs(mv_i) / 1000 + 1, "power");
+        }
+    }
+}
+
+// A triggered read is the trigger, one ready poll that also returns the bus
+// voltage, the shunt read and the power down
+static void test_ina219_transactions() {
+    ina219_handle_t handle;
+    float mv_f, ma_f, mw_f;
+    int32_t mv_i, ma_i, mw_i;
+
+    ina219_sim_reset(1);
+    ina219_sim_set_signal(INA219_ADDRESS_0, {5000, 3700, 0, 0});
+    check(ina219_basic_init(&handle, INA219_ADDRESS_0, SHUNT_OHM) == 0, "ina219 init");
+
+    ina219_sim_clear_stats();
+    check(ina219_basic_read_triggered(&handle, &mv_f, &ma_f, &mw_f) == 0, "ina219 float read");
+    check(ina219_sim_get_stats().reads == 2 && ina219_sim_get_stats().writes == 2, "float read transactions");
+
+    ina219_sim_clear_stats();
+    check(ina219_basic_read_triggered_fixed(&handle, &mv_i, &ma_i, &mw_i) == 0, "ina219 fixed read");
+    check(ina219_sim_get_stats().reads == 2 && ina219_sim_get_stats().writes == 2, "fixed read transactions");
+}
+
+static void test_running_stats() {
+    RunningStats<int32_t> fixed;
+    RunningStats<float> real;
+
+    for (int i = 0; i < 60; i++) {
+        int32_t value = 3700 + (i * 7919) % 97 - 48;
+        fixed.add(value);
+        real.add((float)value);
+    }
+
+    check(fixed.get_min() == lroundf(real.get_min()), "min");
+    check(fixed.get_max() == lroundf(real.get_max()), "max");
+    check(std::abs(fixed.get_mean() - lroundf(real.get_mean())) <= 1, "mean");
+    check(std::abs(fixed.get_stddev() - lroundf(real.get_stddev())) <= 1, "stddev");
+}
+
+static void write_char(char ch, uintptr_t arg) {
+    reinterpret_cast<FixedString<64> *>(arg)->append(ch);
+}
+
+static void test_jems_fixed() {
+    static const struct {
+        int64_t value;
+        uint8_t decimals;
+        const char *text;
+    } cases[] = {
+        {2345, 2, "23.45"},
+        {-1234, 2, "-12.34"},
+        {5, 2, "0.05"},
+        {-5, 1, "-0.5"},
+        {1000, 1, "100.0"},
+        {42, 0, "42"},
+        {-1234567890123, 9, "-1234.567890123"},
+        {INT64_MIN, 9, "-9223372036.854775808"},
+    };
+
+    for (const auto &c : cases) {
+        jems_level_t levels[2];
+        jems_t jems;
+        FixedString<64> out;
+
+        jems_init(&jems, levels, 2, write_char, reinterpret_cast<uintptr_t>(&out));
+        jems_fixed(&jems, c.value, c.decimals);
+        if (strcmp(out.c_str(), c.text) != 0) {
+            printf("jems_fixed(%lld, %d): %s, expected %s\n", (long long)c.value, c.decimals, out.c_str(), c.text);
+            failures++;
+        }
+    }
+}
+
+int main() {
+    test_ina219();
+    test_ina219_transactions();
+    test_running_stats();
+    test_jems_fixed();
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <random>
+
+#include "driver_ina219_interface.h"
+#include "Ina219Sim.h"
+
+#define REG_CONF 0
+#define REG_SHUNT 1
+#define REG_BUS 2
+#define REG_POWER 3
+#define REG_CURRENT 4
+#define REG_CALIBRATION 5
+
+#define CONF_DEFAULT 0x399F
+#define CONF_RESET (1 << 15)
+#define BUS_CNVR (1 << 1)
+#define SHUNT_LSB_UV 10.0
+#define BUS_LSB_MV 4.0
+
+typedef struct {
+    uint8_t addr;
+    bool used;
+    ina219_sim_signal_t signal;
+    uint16_t regs[6];
+} sim_chip_t;
+
+static sim_chip_t chips[INA219_SIM_MAX_CHIPS];
+static ina219_sim_stats_t stats;
+static std::mt19937 rng;
+
+static sim_chip_t *find_chip(uint8_t addr) {
+    for (auto &chip : chips) {
+        if (chip.used && chip.addr == addr) {
+            return &chip;
+        }
+    }
+    for (auto &chip : chips) {
+        if (!chip.used) {
+            chip = {addr, true, {}, {CONF_DEFAULT}};
+            return &chip;
+        }
+    }
+    return nullptr;
+}
+
+// 12 bit modes average 2 to 128 samples, the others take one
+static int adc_samples(uint16_t adc_mode) {
+    return adc_mode & 0x8 ? 1 << (adc_mode & 0x7) : 1;
+}
+
+// The chip averages the codes of its samples
+static int32_t convert(double value, double noise, double lsb, int samples) {
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    int64_t sum = 0;
+
+    for (int i = 0; i < samples; i++) {
+        sum += std::llround((value + noise * gauss(rng)) / lsb);
+    }
+    return (int32_t)std::llround((double)sum / samples);
+}
+
+static void run_conversion(sim_chip_t *chip) {
+    uint16_t conf = chip->regs[REG_CONF];
+    int32_t range = 4000 << ((conf >> 11) & 0x3);
+    int32_t shunt = convert(chip->signal.shunt_uv, chip->signal.shunt_noise_uv, SHUNT_LSB_UV,
+                            adc_samples((conf >> 3) & 0xF));
+    int32_t bus = convert(chip->signal.bus_mv, chip->signal.bus_noise_mv, BUS_LSB_MV,
+                          adc_samples((conf >> 7) & 0xF));
+
+    shunt = shunt > range ? range : shunt < -range ? -range : shunt;
+    bus = bus < 0 ? 0 : bus > 0x1FFF ? 0x1FFF : bus;
+
+    // The register equations of the datasheet
+    int32_t current = shunt * chip->regs[REG_CALIBRATION] / 4096;
+    chip->regs[REG_SHUNT] = (uint16_t)(int16_t)shunt;
+    chip->regs[REG_BUS] = (uint16_t)(bus << 3) | BUS_CNVR;
+    chip->regs[REG_CURRENT] = (uint16_t)(int16_t)current;
+    chip->regs[REG_POWER] = (uint16_t)(std::abs(current) * bus / 5000);
+    stats.conversions++;
+}
+
+void ina219_sim_reset(uint32_t seed) {
+    for (auto &chip : chips) {
+        chip = {};
+    }
+    rng.seed(seed);
+    ina219_sim_clear_stats();
+}
+
+void ina219_sim_set_signal(uint8_t addr, const ina219_sim_signal_t &signal) {
+    find_chip(addr)->signal = signal;
+}
+
+const ina219_sim_stats_t &ina219_sim_get_stats() {
+    return stats;
+}
+
+void ina219_sim_clear_stats() {
+    stats = {};
+}
+
+//
+// driver_ina219_interface.h
+//
+
+void ina219_interface_set_bus(struct i2c_bus_t *) {
+}
+
+uint8_t ina219_interface_iic_init(void) {
+    return 0;
+}
+
+uint8_t ina219_interface_iic_deinit(void) {
+    return 0;
+}
+
+uint8_t ina219_interface_iic_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len) {
+    sim_chip_t *chip = find_chip(addr);
+    if (chip == nullptr || reg > REG_CALIBRATION || len != 2) {
+        return 1;
+    }
+
+    stats.reads++;
+    buf[0] = chip->regs[reg] >> 8;
+    buf[1] = chip->regs[reg] & 0xFF;
+    if (reg == REG_POWER) {
+        chip->regs[REG_BUS] &= ~BUS_CNVR;
+    }
+    return 0;
+}
+
+uint8_t ina219_interface_iic_write(uint8_t addr, uint8_t reg, uint8_t *buf, uint16_t len) {
+    sim_chip_t *chip = find_chip(addr);
+    if (chip == nullptr || (reg != REG_CONF && reg != REG_CALIBRATION) || len != 2) {
+        return 1;
+    }
+
+    stats.writes++;
+    uint16_t value = (uint16_t)(buf[0] << 8 | buf[1]);
+    if (reg == REG_CALIBRATION) {
+        chip->regs[REG_CALIBRATION] = value & 0xFFFE;
+        return 0;
+    }
+
+    if (value & CONF_RESET) {
+        *chip = {chip->addr, true, chip->signal, {CONF_DEFAULT}};
+        return 0;
+    }
+    chip->regs[REG_CONF] = value;
+    chip->regs[REG_BUS] &= ~BUS_CNVR;
+    uint16_t mode = value & 0x7;
+    if (mode != 0 && mode != 4) {
+        run_conversion(chip);
+    }
+    return 0;
+}
+
+void ina219_interface_delay_ms(uint32_t ms) {
+    stats.delay_ms += ms;
+}
+
+void ina219_interface_debug_print(const char *const fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
@@ -0,0 +1,32 @@
+#ifndef INA219SIM_H
+#define INA219SIM_H
+
+#include <cstdint>
+
+#define INA219_SIM_MAX_CHIPS 2
+
+// Input of one simulated chip, the noise is per ADC sample
+typedef struct {
+    double shunt_uv;
+    double bus_mv;
+    double shunt_noise_uv;
+    double bus_noise_mv;
+} ina219_sim_signal_t;
+
+// Bus traffic and time spent in driver delays, since the last reset
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t delay_ms;
+    uint32_t conversions;
+} ina219_sim_stats_t;
+
+// Stands in for driver_ina219_interface.cpp on the host. Each chip averages
+// noisy ADC samples like the INA219 does, so the driver and the firmware
+// averaging can be run against a known signal.
+void ina219_sim_reset(uint32_t seed);
+void ina219_sim_set_signal(uint8_t addr, const ina219_sim_signal_t &signal);
+const ina219_sim_stats_t &ina219_sim_get_stats();
+void ina219_sim_clear_stats();
+
+#endif //INA219SIM_H
@@ -0,0 +1,118 @@
+#include <cmath>
+#include <cstdio>
+
+#include "driver_ina219_basic.h"
+#include "Ina219Sim.h"
+#include "RunningStats.h"
+
+// Noise of the report current against the number of wakes per report, for
+// each INA219 averaging mode. A report is the firmware mean of
+// readings_per_report triggered conversions, as in do_measurements.
+
+#define SHUNT_OHM 0.1
+#define SIGNAL_MA 80.0
+#define SHUNT_NOISE_UV 40.0         // 4 LSB per ADC sample
+#define BATTERY_MV 3700.0
+#define BUS_NOISE_MV 8.0
+#define REPORTS 300
+#define NOISE_TOLERANCE 0.3         // Relative, where the ADC noise dominates the LSB
+
+typedef struct {
+    ina219_adc_mode_t mode;
+    int samples;
+} adc_mode_t;
+
+static const adc_mode_t adc_modes[] = {
+    {INA219_ADC_MODE_12_BIT_1_SAMPLES, 1},
+    {INA219_ADC_MODE_12_BIT_2_SAMPLES, 2},
+    {INA219_ADC_MODE_12_BIT_4_SAMPLES, 4},
+    {INA219_ADC_MODE_12_BIT_8_SAMPLES, 8},
+    {INA219_ADC_MODE_12_BIT_16_SAMPLES, 16},
+    {INA219_ADC_MODE_12_BIT_32_SAMPLES, 32},
+    {INA219_ADC_MODE_12_BIT_64_SAMPLES, 64},
+    {INA219_ADC_MODE_12_BIT_128_SAMPLES, 128},
+};
+
+static const int readings_per_report[] = {1, 2, 4, 6, 10, 15, 30, 60};
+
+typedef struct {
+    float noise_ma;                 // Standard deviation of the report current
+    float delay_ms_per_wake;        // Driver waits for the conversion
+} result_t;
+
+static result_t measure(ina219_handle_t *handle, const adc_mode_t &adc, int readings) {
+    RunningStats<float> reports;
+
+    ina219_set_shunt_voltage_adc_mode(handle, adc.mode);
+    ina219_set_bus_voltage_adc_mode(handle, adc.mode);
+    ina219_sim_clear_stats();
+
+    for (int r = 0; r < REPORTS; r++) {
+        RunningStats<float> current;
+        for (int i = 0; i < readings; i++) {
+            float mv, ma, mw;
+            if (ina219_basic_read_triggered(handle, &mv, &ma, &mw) != 0) {
+                return {NAN, NAN};
+            }
+            current.add(ma);
+        }
+        reports.add(current.get_mean());
+    }
+
+    return {reports.get_stddev(), (float)ina219_sim_get_stats().delay_ms / (REPORTS * readings)};
+}
+
+int main() {
+    ina219_handle_t handle;
+    int failures = 0;
+
+    ina219_sim_reset(1);
+    ina219_sim_set_signal(INA219_ADDRESS_0, {SIGNAL_MA * SHUNT_OHM * 1000.0, BATTERY_MV, SHUNT_NOISE_UV, BUS_NOISE_MV});
+    if (ina219_basic_init(&handle, INA219_ADDRESS_0, SHUNT_OHM) != 0) {
+        printf("FAIL: init\n");
+        return 1;
+    }
+
+    float single_sample_noise = SHUNT_NOISE_UV / SHUNT_OHM / 1000.0;
+    float old_noise = 0;            // 1 sample, 60 wakes per report
+    float default_noise = 0;        // 32 samples, 6 wakes per report
+
+    printf("samples  wakes  samples/report  wait_ms/wake  noise_mA  expected_mA\n");
+    for (const adc_mode_t &adc : adc_modes) {
+        for (int readings : readings_per_report) {
+            result_t result = measure(&handle, adc, readings);
+            float expected = single_sample_noise / sqrtf((float)(adc.samples * readings));
+            printf("%7d  %5d  %14d  %12.1f  %8.4f  %11.4f\n", adc.samples, readings, adc.samples * readings,
+                   result.delay_ms_per_wake, result.noise_ma, expected);
+
+            if (std::isnan(result.noise_ma)) {
+                printf("FAIL: read failed\n");
+                failures++;
+                continue;
+            }
+            // Below one LSB per conversion the rounding of the averaged code adds its own error
+            bool noise_dominated = SHUNT_NOISE_UV / sqrt(adc.samples) >= 10.0;
+            if (noise_dominated && fabsf(result.noise_ma - expected) > NOISE_TOLERANCE * expected) {
+                printf("FAIL: noise does not follow 1/sqrt(samples per report)\n");
+                failures++;
+            }
+
+            if (adc.samples == 1 && readings == 60) {
+                old_noise = result.noise_ma;
+            }
+            if (adc.samples == 32 && readings == 6) {
+                default_noise = result.noise_ma;
+            }
+        }
+    }
+
+    // The default profile takes a tenth of the wakes and must not be noisier
+    printf("1 x 60: %.4f mA, 32 x 6: %.4f mA\n", old_noise, default_noise);
+    if (default_noise > old_noise) {
+        printf("FAIL: 32 samples x 6 wakes is noisier than 1 sample x 60 wakes\n");
+        failures++;
+    }
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
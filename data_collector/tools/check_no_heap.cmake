@@ -0,0 +1,22 @@
+# Fails when the linked image references the heap allocator.
+# Usage: cmake -DNM=<nm> -DELF=<elf> -P check_no_heap.cmake
+
+execute_process(COMMAND ${NM} ${ELF} OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+
+# malloc and its newlib, Pico SDK wrapper and C++ operator new variants
+set(heap_symbols malloc calloc realloc _malloc_r _calloc_r _realloc_r __wrap_malloc __wrap_calloc __wrap_realloc _Znwj _Znaj)
+
+# Only defined symbols count. newlib refers to malloc weakly, e.g. from
+# __register_exitproc, and those references stay unresolved without a heap.
+foreach (symbol ${heap_symbols})
+    if (symbols MATCHES "[0-9a-fA-F]+ [A-Za-z] ${symbol}\n")
+        list(APPEND found ${symbol})
+    endif()
+endforeach()
+
+if (found)
+    message(FATAL_ERROR "Heap allocation linked into ${ELF}: ${found}")
+endif()
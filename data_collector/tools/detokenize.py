@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Decode the binary log of a LOG_TOKENIZED build.
+
+The token database is built from the LOG_* statements in the firmware
+sources, hashed the same way as log_token() in Log.h.
+
+    python3 tools/detokenize.py /dev/ttyACM0
+    python3 tools/detokenize.py --database    # list the tokens
+"""
+
+import argparse
+import codecs
+import re
+import struct
+import sys
+from pathlib import Path
+
+RECORD_SYNC = 0xA5
+LEVELS = {"E": "ERROR", "W": "WARN", "I": "INFO", "D": "DEBUG"}
+LOG_STATEMENT = re.compile(r'LOG_(?:ERROR|WARN|INFO|DEBUG)\(\s*"((?:[^"\\]|\\.)*)"')
+
+
+def log_token(format_bytes):
+    token = 2166136261
+    for b in format_bytes:
+        token = ((token ^ b) * 16777619) & 0xFFFFFFFF
+    return token
+
+
+def build_database(source_dir):
+    database = {}
+    for path in sorted(source_dir.rglob("*")):
+        if path.suffix not in (".c", ".cpp", ".h"):
+            continue
+        for match in LOG_STATEMENT.finditer(path.read_text(errors="replace")):
+            fmt = codecs.escape_decode(match.group(1).encode())[0]
+            token = log_token(fmt)
+            if token in database and database[token] != fmt:
+                print(f"token collision {token:08x}: {database[token]!r} {fmt!r}", file=sys.stderr)
+            database[token] = fmt
+    return database
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if b < 0x80:
+            return value, pos
+
+
+def decode_arguments(data):
+    args = []
+    pos = 0
+    try:
+        while pos < len(data):
+            tag = chr(data[pos])
+            pos += 1
+            if tag == "i":
+                value, pos = read_varint(data, pos)
+                args.append(str((value >> 1) ^ -(value & 1)))
+            elif tag == "f":
+                args.append(f"{struct.unpack_from('<f', data, pos)[0]:.2f}")
+                pos += 4
+            elif tag == "s":
+                length = data[pos]
+                args.append(data[pos + 1:pos + 1 + length].decode(errors="replace"))
+                pos += 1 + length
+            else:
+                args.append("<?>")
+                break
+    except (IndexError, struct.error):
+        args.append("<truncated>")
+    return args
+
+
+def format_message(fmt, args):
+    parts = fmt.decode(errors="replace").split("{}")
+    text = parts[0]
+    for i, part in enumerate(parts[1:]):
+        text += (args[i] if i < len(args) else "{}") + part
+    return text
+
+
+def decode_record(record, database):
+    level = LEVELS.get(chr(record[0]), "?")
+    token = int.from_bytes(record[1:5], "little")
+    millis, pos = read_varint(record, 5)
+    args = decode_arguments(record[pos:])
+
+    if token in database:
+        message = format_message(database[token], args)
+    else:
+        message = f"<unknown token {token:08x}> " + " ".join(args)
+    return f"[{millis}] {level} {message}"
+
+
+def decode_stream(stream, database):
+    buf = bytearray()
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            return
+        buf += chunk
+
+        # Resynchronise on the next sync byte after garbage or a partial record
+        start = buf.find(RECORD_SYNC)
+        if start < 0:
+            buf.clear()
+            continue
+        del buf[:start]
+        if len(buf) < 2 or len(buf) < 2 + buf[1]:
+            continue
+
+        record = bytes(buf[2:2 + buf[1]])
+        del buf[:2 + len(record)]
+        try:
+            print(decode_record(record, database), flush=True)
+        except IndexError:
+            print("<malformed record>", flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", help="serial device or capture file, stdin by default")
+    parser.add_argument("--sources", type=Path, default=Path(__file__).resolve().parent.parent,
+                        help="firmware source directory")
+    parser.add_argument("--database", action="store_true", help="print the token database and exit")
+    args = parser.parse_args()
+
+    database = build_database(args.sources)
+    if args.database:
+        for token, fmt in sorted(database.items()):
+            print(f"{token:08x} {fmt.decode(errors='replace')}")
+        return
+
+    if args.input is None:
+        decode_stream(sys.stdin.buffer, database)
+    else:
+        with open(args.input, "rb", buffering=0) as stream:
+            decode_stream(stream, database)
+
+
+if __name__ == "__main__":
+    main()
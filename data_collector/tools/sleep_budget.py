@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Daily charge budget from the sleep counters of the reports.
+
+The energy meter only samples while awake, so it cannot see the sleep
+current. This model takes the awake and asleep times of the "sleep" object
+and the currents measured on the bench (see the README) and works out the
+daily charge, and what dormant sleep would save if a board revision freed a
+GPIN pin for the RTC clock.
+
+Input is one MQTT payload per line, a report or a batch of reports:
+
+    mosquitto_sub -t <topic> > reports.txt
+    python3 tools/sleep_budget.py reports.txt --awake-ma 45 --sleep-ma 2.1
+"""
+
+import argparse
+import json
+import sys
+
+BATTERY_CAPACITY_MAH = 3000.0   # As in EnergyMeter.h
+PICO_DORMANT_SAVING_MA = 0.5    # Pico datasheet, sleep 1.3 mA and dormant 0.8 mA at the Pico itself
+HOURS_PER_DAY = 24.0
+
+
+def read_counters(lines):
+    """Returns the (awake_ms, asleep_ms) of each report that has them, in order."""
+    counters = []
+    for line in lines:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            payload = json.loads(line)
+        except json.JSONDecodeError:
+            print(f"skipping malformed payload: {line[:40]}", file=sys.stderr)
+            continue
+        for report in payload if isinstance(payload, list) else [payload]:
+            sleep = report.get("sleep") if isinstance(report, dict) else None
+            if sleep is not None:
+                counters.append((sleep["awake_ms"], sleep["asleep_ms"]))
+    return counters
+
+
+def total_times(counters):
+    """Sums the counters over reboots. They count since boot, so the last
+    report before each reboot holds the whole time of that boot."""
+    awake_ms = asleep_ms = 0
+    for i, (awake, asleep) in enumerate(counters):
+        last_of_boot = i + 1 == len(counters) or sum(counters[i + 1]) < awake + asleep
+        if last_of_boot:
+            awake_ms += awake
+            asleep_ms += asleep
+    return awake_ms, asleep_ms
+
+
+def daily_charge_mah(awake_fraction, awake_ma, sleep_ma):
+    return (awake_fraction * awake_ma + (1.0 - awake_fraction) * sleep_ma) * HOURS_PER_DAY
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", help="file of MQTT payloads, stdin by default")
+    parser.add_argument("--awake-ma", type=float, required=True, help="mean battery current while awake")
+    parser.add_argument("--sleep-ma", type=float, required=True, help="battery current in light sleep")
+    parser.add_argument("--dormant-ma", type=float,
+                        help=f"battery current in dormant sleep, the sleep current less {PICO_DORMANT_SAVING_MA} mA by default")
+    parser.add_argument("--capacity-mah", type=float, default=BATTERY_CAPACITY_MAH)
+    args = parser.parse_args()
+
+    if args.input is None:
+        counters = read_counters(sys.stdin)
+    else:
+        with open(args.input) as f:
+            counters = read_counters(f)
+
+    awake_ms, asleep_ms = total_times(counters)
+    if awake_ms + asleep_ms == 0:
+        sys.exit("no reports with sleep counters")
+
+    if args.awake_ma <= 0 or args.sleep_ma <= 0:
+        sys.exit("the currents must be positive")
+
+    dormant_ma = args.dormant_ma if args.dormant_ma is not None else max(args.sleep_ma - PICO_DORMANT_SAVING_MA, 0.0)
+    awake_fraction = awake_ms / (awake_ms + asleep_ms)
+    light = daily_charge_mah(awake_fraction, args.awake_ma, args.sleep_ma)
+    dormant = daily_charge_mah(awake_fraction, args.awake_ma, dormant_ma)
+
+    print(f"reports       {len(counters)}, {(awake_ms + asleep_ms) / 3600000:.1f} h covered")
+    print(f"awake         {awake_fraction * 100:.2f} %")
+    print(f"light sleep   {light:.1f} mAh/day, {args.capacity_mah / light:.1f} days on a full battery")
+    print(f"dormant       {dormant:.1f} mAh/day, {args.capacity_mah / dormant:.1f} days on a full battery")
+    print(f"saving        {light - dormant:.1f} mAh/day ({(light - dormant) / light * 100:.1f} %)")
+
+
+if __name__ == "__main__":
+    main()